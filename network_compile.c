@@ -0,0 +1,25 @@
+/*
+ * Compiles a network (in the matrix or the edge list format of input.txt) into a binary snapshot, see train_input.h.
+ * The simulators map the snapshot given with --input=FILE instead of parsing the network again on every run.
+ *
+ * Usage: network_compile [input.txt] [input.net]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "train_input.h"
+
+int main(int argc, char *argv[]) {
+    char *in_name = argc > 1 ? argv[1] : "input.txt";
+    char *out_name = argc > 2 ? argv[2] : "input.net";
+    struct network_input input;
+    if (argc > 3) {
+        printf("Usage: %s [input.txt] [input.net]\n", argv[0]);
+        exit(1);
+    }
+    if (load_network_input(&input, in_name) != 0 || write_network_snapshot(&input, out_name) != 0) {
+        exit(1);
+    }
+    printf("%s: %d stations, %d links\n", out_name, input.num_stations, input.graph.num_links);
+    free_network_input(&input);
+    return 0;
+}
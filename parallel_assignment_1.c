@@ -3,6 +3,28 @@
  * 1. Only one train in a given direction and line at a time can load at a station. This means that if two trains from different lines are at the same station,
  * they can both load at the same time.
  * 2. Upon reaching a terminal station (Tamp -> Changi | direction: Right). Train will load for station[right][changi] rather than station[left][changi]. 
+ * 3. When several trains want the same link or station in a time tick, the train with the lowest global index gets it. Trains enter a line
+ * in order of their index. This makes the output the same for any number of threads.
+ *
+ * TICK MODEL: Every time tick runs in phases separated by barriers.
+ * A. Trains count down loading / transit time, arrive, enter the network, and post an intent for the link they want to board.
+ * B. Intents for links are resolved. The winners board their link and free their station.
+ * C. Waiting trains post an intent for the station they want to load at.
+ * D. Intents for stations are resolved. The winners start loading.
+ * E. Platforms ready to load are counted as waiting, platforms of trains that finished loading are freed and the links of the
+ *    trains that arrived are released. Each thread does this for its own chunk of platforms and its own arrivals, and formats
+ *    the log tokens of its chunk of trains into its segment of the tick in the trace ring. A writer thread writes the
+ *    segments of a tick in order with one writev (train_trace.h), so the ticks do not wait on the file.
+ * Intents are posted with an atomic min on a per link / per station claim, so the winner does not depend on the order of the threads.
+ *
+ * EVENT ENGINE (--engine=event): Runs the same phases on a single thread, but only for the trains that have an event due in
+ * the time tick. Each train has one pending event in a timing wheel (train_wheel.h): its arrival, the end of its loading, or
+ * its next try for a link or a station. A train that finds its link or station busy waits in a FIFO queue of that link or
+ * station, and is only tried again once the link is released or the station is ready to load. Waiting times are added up when
+ * a platform stops being ready to load, and a tick without any movement only hands its number to the trace writer, which
+ * repeats the previous log line. The log is identical to the tick engine.
+ * Only the event engine parks the blocked trains. The tick engine still goes over every train, blocked or not, in every
+ * phase of every tick, so its work per tick grows with the number of trains rather than with the trains that move.
 */
 #include <omp.h>
 #include <stdio.h>
@@ -11,6 +33,11 @@
 #include <limits.h>
 #include <math.h>
 #include <time.h>
+#include "train_network.h"
+#include "train_input.h"
+#include "train_rng.h"
+#include "train_wheel.h"
+#include "train_trace.h"
 
 // Train Status
 #define IN_TRANSIT 1
@@ -23,12 +50,6 @@
 // Links
 #define LINK_IS_EMPTY -1
 #define LINK_IS_USED 1
-#define LINK_DEFAULT_STATUS 0
-#define FREE_THIS_LINK 2
-
-// Direction
-#define LEFT 0      // FROM END OF ARRAY TO START 
-#define RIGHT 1     // FROM START OF ARRAY TO END
 
 // Station status
 #define READY_TO_LOAD -1
@@ -40,160 +61,625 @@
 #define WAITING_TO_LOAD -1
 #define FINISHED_LOADING 0
 
-// Introducing trains into the network
-#define INTRODUCED 1
-#define NOT_INTRODUCED 0
+// Intents
+#define NO_INTENT -1
+#define NO_CLAIM -1
+
+// Engines
+#define ENGINE_TICK 0
+#define ENGINE_EVENT 1
+
+// Run modes
+#define RUN_FULL 0          // trace every time tick
+#define RUN_SAMPLED 1       // trace every k-th time tick
+#define RUN_WINDOW 2        // trace time ticks t0 to t1
+#define RUN_SUMMARY 3       // only write the average waiting times
 
-struct train_type
+// Events of the event engine, named after the phase that handles them
+#define EVENT_DEPART 0      // Phase A: ask for the link to the next station
+#define EVENT_ARRIVE 1      // Phase A: arrive at the next station
+#define EVENT_LOAD_TRY 2    // Phase C: ask for the station to load at
+#define EVENT_LOAD_DONE 3   // Master: finish loading and free the platform
+#define NUM_EVENTS 4
+
+// Run options
+struct run_options
 {
-    int loading_time; // -1 waiting to load | 0 has loaded finish at the station| > 0 for currently loading
-    int status;       // 1 for in transit | 0 for in station | -1 for not in network
-    int direction;    // 1 for up  | 0 for down
-    int station;      // -1 for not in any station | > 0 for index of station it is in
-    int transit_time; // -1 for NA | > 0 for in transit
-    int line;
+    int num_threads;  // number of OpenMP threads ticking the network
+    uint64_t seed;    // seed of the loading times
+    int engine;       // ENGINE_TICK | ENGINE_EVENT
+    int trace;        // TRACE_FORMAT_TEXT (log.txt) | TRACE_FORMAT_BINARY | TRACE_FORMAT_DELTA (log.bin)
+    int keyframe_interval; // time ticks between the keyframes of the delta trace
+    int compress;     // 1 to write the trace as a zstd frame (log.txt.zst, log.bin.zst)
+    int run_mode;     // RUN_FULL | RUN_SAMPLED | RUN_WINDOW | RUN_SUMMARY
+    int sample_step;  // RUN_SAMPLED: trace every sample_step-th time tick
+    int window_first; // RUN_WINDOW: first and last time tick traced
+    int window_last;
+    char *input_name; // network to simulate: input.txt or a snapshot of network_compile
 };
 
+/**
+ * Time ticks that go into the trace. is_traced_tick is picked once from the run mode, so the engines never look at the
+ * run mode while ticking. The traced ticks are first_tick, first_tick + tick_step, ... (num_ticks of them).
+ */
+struct trace_mode
+{
+    int (*is_traced_tick)(struct trace_mode *mode, int time_tick);
+    int first_tick;
+    int tick_step;
+    int num_ticks;
+};
+
+// Trains are stored as a struct of arrays, indexed by the global index of the train. Every array holds capacity
+// elements and starts on a cache line, so the count down kernels can run over whole cache lines of trains.
+#define CACHE_LINE_SIZE 64
+#define TRAINS_PER_CACHE_LINE (CACHE_LINE_SIZE / sizeof(int))
+struct train_store
+{
+    int capacity;
+    int *loading_time; // -1 waiting to load | 0 has loaded finish at the station| > 0 for currently loading
+    int *status;       // 1 for in transit | 0 for in station | -1 for not in network
+    int *direction;    // 1 for up  | 0 for down
+    int *station;      // -1 for not in any station | > 0 for index of station it is in
+    int *transit_time; // -1 for NA | > 0 for in transit
+    int *line;
+    int *changed_tick; // last time tick in which the train entered the network, arrived, boarded or started loading
+};
+
+// What a train wants to claim in the current time tick
+struct train_intent
+{
+    int link;         // id of the link to board | NO_INTENT
+    int station;      // global index of the station to load at | NO_INTENT
+};
+
+// FIFO queue of trains waiting for a link or a station, threaded through queue_next of the event engine.
+struct wait_queue
+{
+    int head;
+    int tail;
+};
+
+// State of the event engine
+struct event_engine
+{
+    struct timing_wheel wheel;
+    int *event;                 // [train] kind of the pending event of the train
+    int *due_trains[NUM_EVENTS];// [event] trains whose event is due in the current time tick
+    int num_due[NUM_EVENTS];
+    int *link_claimers;         // trains that asked for a link in the current time tick
+    int num_link_claimers;
+    int *station_claimers;      // trains that asked for a station in the current time tick
+    int num_station_claimers;
+    int *freed_links;           // links freed in the current time tick
+    int num_freed_links;
+    int *ready_since[3][2];     // [line][direction][station] first time tick counted as ready to load | -1 if not ready
+    int *queue_next;            // [train] next train in the same wait queue | WHEEL_NONE
+    struct wait_queue *link_queues;     // [link] trains that finished loading and wait for the link to be released
+    struct wait_queue *station_queues;  // [global station] trains that wait for the station to be ready to load
+};
+
+
+// Function declaration: Trains
+void init_train_store(struct train_store *trains, int num_green_trains, int num_yellow_trains, int num_blue_trains);
+void get_thread_chunk(int num_items, int *first_item, int *last_item);
+void countdown_trains(struct train_store *trains, int first_train, int last_train, unsigned char train_events[]);
 
 // Function declaration: Updating network
-void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, char *line_stations_name_list[], char *all_stations_list[], int num_stations, int num_network_train_stations, int train_number, int *introduced_train_left, int *introduced_train_right);
-void in_station_action(struct train_type *train, int train_number, int S, char *line_stations_name_list[], int **line_stations, char *all_stations_list[], int num_stations, double all_stations_popularity_list[], int **link_transit_time, int **links_status, int station_status[]);
-void in_transit_action(struct train_type *train, int num_stations, int S, int **line_stations, char* line_stations_name_list[], char *all_stations_list[], int **links_status_update);
-void update_train_stations(int direction_index, int num_stations, int **train_stations, struct train_type trains[]);
-void update_links_status(int **links_status_update, int **links_status, int S);
+void introduce_train_into_network(struct train_store *trains, int train_number, double all_stations_popularity_list[], int **line_stations, struct route_table *route, int starting_station, uint64_t seed, int time_tick);
+void in_station_action(struct train_store *trains, int train_number, struct route_table *route, int links_status[], long long link_claims[], struct train_intent *intent, int time_tick);
+void in_transit_action(struct train_store *trains, int train_number, struct route_table *route, int **line_stations, int freed_links[], int *num_freed_links, int time_tick);
+void resolve_link_intent(struct train_store *trains, int train_number, struct route_table *route, int links_status[], int station_status[], long long link_claims[], struct train_intent *intent, int time_tick);
+void post_station_intent(struct train_store *trains, int train_number, struct route_table *route, int station_status[], long long station_claims[], struct train_intent *intent, int time_tick);
+void resolve_station_intent(struct train_store *trains, int train_number, int **line_stations, double all_stations_popularity_list[], int station_status[], long long station_claims[], struct train_intent *intent, uint64_t seed, int time_tick);
+void update_platforms(int *platforms[], int waiting_counts[], int first_platform, int last_platform, struct train_store *trains);
+void update_links_status(int freed_links[], int num_freed_links, int links_status[]);
+
+// Function declaration: Event engine
+void init_event_engine(struct event_engine *engine, int num_trains, int num_links, int S, struct route_table routes[]);
+void free_event_engine(struct event_engine *engine);
+void schedule_train_event(struct event_engine *engine, int train_number, int event, int time_tick);
+void schedule_loading(struct event_engine *engine, struct train_store *trains, int train_number, int time_tick);
+void sync_platform_waiting_time(int platform, int *ready_since, int *waiting_time, int from_tick);
+void park_train(struct event_engine *engine, struct wait_queue *queue, int train_number);
+int drain_queue(struct wait_queue *queue);
+void run_event_engine(struct train_store *trains, int num_trains, int num_links, int S, int line_start[], int line_end[], struct route_table routes[], int **line_platforms[], int **line_waiting_times[], double all_stations_popularity_list[], int links_status[], int station_status[], struct train_intent intents[], long long link_claims[], long long station_claims[], int N, uint64_t seed, struct trace_mode *mode, struct trace_writer *writer);
 
 // Function declaration: Calculating waiting time
 double get_average_waiting_time(int num_green_stations, int **green_station_waiting_times, int N);
 void get_longest_shortest_average_waiting_time(int num_green_stations, int **green_station_waiting_times, int N, double *longest_average_waiting_time, double *shortest_average_waiting_time);
 
 // Function declaration: Helper functions
-void print_status(struct train_type trains[], int num_trains, char *G[], int num_stations, int line);
-void print_output(int iteration, struct train_type trains[], int num_trains, char *G[], char *Y[], char *B[], int num_green_trains, int num_yellow_trains, int num_blue_trains, char *all_stations_list[], int num_all_stations, int num_green_stations, int num_yellow_stations, int num_blue_stations, FILE* fp);
+void print_status(struct train_store *trains, int num_trains, char *G[], int num_stations, int line);
+int format_train_positions(struct train_store *trains, int first_train, int last_train, struct route_table routes[], int num_green_trains, int num_yellow_trains, char *out);
+unsigned int pack_train_state(struct train_store *trains, int train_number);
+int pack_train_states(struct train_store *trains, int first_train, int last_train, char *out);
+int pack_train_changes(struct train_store *trains, int first_train, int last_train, int time_tick, char *out);
+int write_train_positions(struct trace_writer *writer, struct trace_slot *slot, struct train_store *trains, int first_train, int last_train, struct route_table routes[], int num_green_trains, int num_yellow_trains, char *out);
+void start_trace(struct trace_writer *writer, FILE *fp, FILE *index_fp, struct run_options *options, struct trace_mode *mode, struct trace_header *header, int num_segments, int segment_trains);
 int get_next_station(int prev_station, int direction, int num_stations);
-int get_all_station_index(int num_all_stations, int line_station_index, char *line_stations[], char *all_stations_list[]);
-int calculate_loadtime(double popularity);
 int change_train_direction(int direction);
+int claim_slot(int *slot, int expected, int desired);
+void post_claim(long long *claim, int time_tick, int train_number);
+int won_claim(long long *claim, int time_tick, int train_number);
+void parse_run_options(int argc, char *argv[], struct run_options *options);
+void init_trace_mode(struct trace_mode *mode, struct run_options *options, int N);
+int trace_every_tick(struct trace_mode *mode, int time_tick);
+int trace_sampled_tick(struct trace_mode *mode, int time_tick);
+int trace_window_tick(struct trace_mode *mode, int time_tick);
+int trace_no_tick(struct trace_mode *mode, int time_tick);
 
 
-// Functions: Updating network
-void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, char *line_stations_name_list[], char *all_stations_list[], int num_stations, int num_network_train_stations, int train_number, int *introduced_train_left, int *introduced_train_right) {
-    int starting_station = -1;
-    if (*introduced_train_right == NOT_INTRODUCED) {
-        starting_station = 0;
-    } else if (*introduced_train_left == NOT_INTRODUCED) {
-        starting_station = num_stations - 1;
-    }
-    // Introducing a train into the network.
-    if (starting_station != -1) {
-        if (starting_station == 0) {
-            *introduced_train_right = INTRODUCED;
-            train->direction = LEFT;
+// Functions: Trains
+void init_train_store(struct train_store *trains, int num_green_trains, int num_yellow_trains, int num_blue_trains) {
+    int i;
+    int num_trains = num_green_trains + num_yellow_trains + num_blue_trains;
+    int capacity = (num_trains + TRAINS_PER_CACHE_LINE - 1) / TRAINS_PER_CACHE_LINE * TRAINS_PER_CACHE_LINE;
+    size_t size = capacity * sizeof(int);
+    trains->capacity = capacity;
+    trains->loading_time = aligned_alloc(CACHE_LINE_SIZE, size);
+    trains->status = aligned_alloc(CACHE_LINE_SIZE, size);
+    trains->direction = aligned_alloc(CACHE_LINE_SIZE, size);
+    trains->station = aligned_alloc(CACHE_LINE_SIZE, size);
+    trains->transit_time = aligned_alloc(CACHE_LINE_SIZE, size);
+    trains->line = aligned_alloc(CACHE_LINE_SIZE, size);
+    trains->changed_tick = aligned_alloc(CACHE_LINE_SIZE, size);
+    // Slots past the last train stay out of the network, so the kernels never have to check for the end of the trains.
+    for (i = 0; i < capacity; i++) {
+        trains->loading_time[i] = WAITING_TO_LOAD;
+        trains->status[i] = NOT_IN_NETWORK;
+        trains->direction[i] = RIGHT;
+        trains->station[i] = -1;
+        trains->transit_time[i] = -1;
+        trains->changed_tick[i] = -1;
+        if (i < num_green_trains) {
+            trains->line[i] = GREEN;
+        } else if (i < num_green_trains + num_yellow_trains) {
+            trains->line[i] = YELLOW;
         } else {
-            *introduced_train_left = INTRODUCED;
-            train->direction = RIGHT;
-        }
-        train->status = IN_STATION;
-        train->station = starting_station;
-        if (line_stations[train->direction][starting_station] == UNVISITED) {
-            line_stations[train->direction][starting_station] = READY_TO_LOAD;
-        }        
-        // If no trains are loading. We will start loading the introduced train immediately.
-        if (line_stations[train->direction][starting_station] == READY_TO_LOAD) {
-            line_stations[train->direction][starting_station] = train_number;                // The train number is the global train index. 
-            int global_station_index = get_all_station_index(num_network_train_stations, train->station, line_stations_name_list, all_stations_list);
-            train->loading_time = calculate_loadtime(all_stations_popularity_list[global_station_index]) - 1; 
-        }
-    }
-}
-void in_station_action(struct train_type *train, int train_number, int S, char *line_stations_name_list[], int **line_stations, char *all_stations_list[], int num_stations, double all_stations_popularity_list[], int **link_transit_time, int **links_status, int station_status[]) {
-    // This train is currently loading at a station.
-    if (train->loading_time > 0) {
-        train->loading_time--;
-    } else if (train->loading_time == FINISHED_LOADING) {
-        int current_station = train->station;
-        int current_all_station_index = get_all_station_index(S, current_station, line_stations_name_list, all_stations_list);
-        int next_station = get_next_station(current_station, train->direction, num_stations);
-        int next_all_station_index = get_all_station_index(S, next_station, line_stations_name_list, all_stations_list);
-        // Link is not occupied, move train into link.
-        #pragma omp critical 
-        {
-            if (links_status[current_all_station_index][next_all_station_index] == LINK_IS_EMPTY) {
-                    train->transit_time = link_transit_time[current_all_station_index][next_all_station_index] - 1;
-                    train->status = IN_TRANSIT;
-                    train->loading_time = WAITING_TO_LOAD;
-                    links_status[current_all_station_index][next_all_station_index] = LINK_IS_USED;
-                    station_status[current_all_station_index] = READY_TO_LOAD;
-            }
+            trains->line[i] = BLUE;
         }
     }
+}
+/**
+ * Splits the items (trains or platforms) into one chunk of whole cache lines of ints per thread, so threads never share a
+ * cache line of an array indexed by the items.
+ */
+void get_thread_chunk(int num_items, int *first_item, int *last_item) {
+    int num_threads = omp_get_num_threads();
+    int thread_id = omp_get_thread_num();
+    int num_lines = (num_items + TRAINS_PER_CACHE_LINE - 1) / TRAINS_PER_CACHE_LINE;
+    int lines_per_thread = (num_lines + num_threads - 1) / num_threads;
+    *first_item = thread_id * lines_per_thread * TRAINS_PER_CACHE_LINE;
+    *last_item = *first_item + lines_per_thread * TRAINS_PER_CACHE_LINE;
+    if (*first_item > num_items) {
+        *first_item = num_items;
+    }
+    if (*last_item > num_items) {
+        *last_item = num_items;
+    }
+}
+/**
+ * Phase A kernel: counts down the loading time of loading trains and the transit time of travelling trains, using masked
+ * updates so that the loop vectorizes (AVX2 / AVX-512 when compiled with -march=native).
+ * Only the trains that need a state transition are flagged in train_events: trains not in the network, trains that had
+ * finished loading before this tick and trains that arrive in this tick. Everything else is done by the kernel.
+ */
+void countdown_trains(struct train_store *trains, int first_train, int last_train, unsigned char train_events[]) {
+    int i;
+    int *restrict status = trains->status;
+    int *restrict loading_time = trains->loading_time;
+    int *restrict transit_time = trains->transit_time;
+    #pragma omp simd
+    for (i = first_train; i < last_train; i++) {
+        int in_station = status[i] == IN_STATION;
+        int in_transit = status[i] == IN_TRANSIT;
+        int finished_loading = in_station & (loading_time[i] == FINISHED_LOADING);
+        loading_time[i] -= in_station & (loading_time[i] > 0);
+        transit_time[i] -= in_transit;
+        train_events[i] = (status[i] == NOT_IN_NETWORK) | finished_loading | (in_transit & (transit_time[i] == 0));
+    }
+}
 
-    int global_station_index = get_all_station_index(S, train->station, line_stations_name_list, all_stations_list);
-    if (station_status[global_station_index] == LOADING) {
-        return;
+// Functions: Updating network
+void introduce_train_into_network(struct train_store *trains, int train_number, double all_stations_popularity_list[], int **line_stations, struct route_table *route, int starting_station, uint64_t seed, int time_tick) {
+    // Introducing a train into the network.
+    if (starting_station == 0) {
+        trains->direction[train_number] = LEFT;
+    } else {
+        trains->direction[train_number] = RIGHT;
+    }
+    trains->status[train_number] = IN_STATION;
+    trains->station[train_number] = starting_station;
+    trains->changed_tick[train_number] = time_tick;
+    // An arriving train may mark the same station as visited in this phase.
+    claim_slot(&line_stations[trains->direction[train_number]][starting_station], UNVISITED, READY_TO_LOAD);
+    // If no trains are loading. We will start loading the introduced train immediately.
+    if (claim_slot(&line_stations[trains->direction[train_number]][starting_station], READY_TO_LOAD, train_number)) {   // The train number is the global train index.
+        int global_station_index = route->station[trains->station[train_number]];
+        trains->loading_time[train_number] = calculate_loadtime(all_stations_popularity_list[global_station_index], seed, train_number, time_tick) - 1;
     }
-    // Load a waiting train
-    #pragma omp critical
-    {   
-        if (train->status == IN_STATION && train->loading_time == WAITING_TO_LOAD && station_status[global_station_index] == READY_TO_LOAD) {
-            train->loading_time = calculate_loadtime(all_stations_popularity_list[global_station_index]) - 1;
-            line_stations[train->direction][train->station] = train_number; // The train number is the global train index
-            station_status[global_station_index] = LOADING;
+}
+// Phase A: Ask for the link to the next station once the train has finished loading. (The loading time is counted down by countdown_trains.)
+void in_station_action(struct train_store *trains, int train_number, struct route_table *route, int links_status[], long long link_claims[], struct train_intent *intent, int time_tick) {
+    if (trains->loading_time[train_number] == FINISHED_LOADING) {
+        int current_station = trains->station[train_number];
+        int link = route->link[trains->direction[train_number]][current_station];
+        // Link is not occupied, ask to move train into link.
+        if (links_status[link] == LINK_IS_EMPTY) {
+            intent->link = link;
+            post_claim(&link_claims[intent->link], time_tick, train_number);
         }
     }
 }
-void in_transit_action(struct train_type *train, int num_stations, int S, int **line_stations, char* line_stations_name_list[], char *all_stations_list[], int **links_status_update) {
-    train->transit_time--;
-    
-    if (train->transit_time == 0) {
+// Phase A: Move the train into the next station when it arrives. (The transit time is counted down by countdown_trains.)
+void in_transit_action(struct train_store *trains, int train_number, struct route_table *route, int **line_stations, int freed_links[], int *num_freed_links, int time_tick) {
+    if (trains->transit_time[train_number] == 0) {
         // Move the train to the next station
         int prev_station;
-        prev_station = train->station;
-        train->station = get_next_station(train->station, train->direction, num_stations);
-        train->status = IN_STATION;
+        prev_station = trains->station[train_number];
+        trains->station[train_number] = route->next_station[trains->direction[train_number]][prev_station];
+        trains->status[train_number] = IN_STATION;
+        trains->changed_tick[train_number] = time_tick;
+        // Mark the link as free, it is released at the end of the time tick.
+        int link = route->link[trains->direction[train_number]][prev_station];
         // Update the direction of the train (For trains reaching a terminal station)
-        if (prev_station < train->station) {
-            train->direction = RIGHT;
+        if (prev_station < trains->station[train_number]) {
+            trains->direction[train_number] = RIGHT;
         } else {
-            train->direction = LEFT;
+            trains->direction[train_number] = LEFT;
         }
         // Update the station if this is the first time it is being visited
-        if (line_stations[train->direction][train->station] == UNVISITED) 
-        {
-            line_stations[train->direction][train->station] = READY_TO_LOAD;
-        }
-        // Mark the link as free to be updated at the master thread.
-        int current_all_station_index = get_all_station_index(S, prev_station, line_stations_name_list, all_stations_list);
-        int next_all_station_index = get_all_station_index(S, train->station, line_stations_name_list, all_stations_list);
-        links_status_update[current_all_station_index][next_all_station_index] = FREE_THIS_LINK;
+        claim_slot(&line_stations[trains->direction[train_number]][trains->station[train_number]], UNVISITED, READY_TO_LOAD);
+        freed_links[(*num_freed_links)++] = link;
     }
 }
+// Phase B: Move the train into the link if it won the link.
+void resolve_link_intent(struct train_store *trains, int train_number, struct route_table *route, int links_status[], int station_status[], long long link_claims[], struct train_intent *intent, int time_tick) {
+    if (intent->link == NO_INTENT) {
+        return;
+    }
+    if (won_claim(&link_claims[intent->link], time_tick, train_number)) {
+        int current_station = trains->station[train_number];
+        int current_all_station_index = route->station[current_station];
+        trains->transit_time[train_number] = route->transit_time[trains->direction[train_number]][current_station] - 1;
+        trains->status[train_number] = IN_TRANSIT;
+        trains->loading_time[train_number] = WAITING_TO_LOAD;
+        trains->changed_tick[train_number] = time_tick;
+        links_status[intent->link] = LINK_IS_USED;
+        station_status[current_all_station_index] = READY_TO_LOAD;
+    }
+    intent->link = NO_INTENT;
+}
+// Phase C: Ask for the station if the train is waiting to load and did not just arrive or enter the network.
+void post_station_intent(struct train_store *trains, int train_number, struct route_table *route, int station_status[], long long station_claims[], struct train_intent *intent, int time_tick) {
+    if (trains->status[train_number] != IN_STATION || trains->loading_time[train_number] != WAITING_TO_LOAD || trains->changed_tick[train_number] == time_tick) {
+        return;
+    }
+    int global_station_index = route->station[trains->station[train_number]];
+    if (station_status[global_station_index] == READY_TO_LOAD) {
+        intent->station = global_station_index;
+        post_claim(&station_claims[global_station_index], time_tick, train_number);
+    }
+}
+// Phase D: Load the train if it won the station.
+void resolve_station_intent(struct train_store *trains, int train_number, int **line_stations, double all_stations_popularity_list[], int station_status[], long long station_claims[], struct train_intent *intent, uint64_t seed, int time_tick) {
+    if (intent->station == NO_INTENT) {
+        return;
+    }
+    if (won_claim(&station_claims[intent->station], time_tick, train_number)) {
+        trains->loading_time[train_number] = calculate_loadtime(all_stations_popularity_list[intent->station], seed, train_number, time_tick) - 1;
+        trains->changed_tick[train_number] = time_tick;
+        line_stations[trains->direction[train_number]][trains->station[train_number]] = train_number; // The train number is the global train index
+        station_status[intent->station] = LOADING;
+    }
+    intent->station = NO_INTENT;
+}
 
 /**
- *  This function goes through the status of all the train stations and checks if any loading trains at the station
- *  has finished loading (loading_time == 0). If it is, then change the status to READY_TO_LOAD.
+ * Phase E: Goes through a chunk of the platforms. Platforms that are ready to load are counted in waiting_counts (indexed
+ * from first_platform). Then, if the train loading at a platform has finished loading (loading_time == 0), the platform
+ * is changed to READY_TO_LOAD. The count comes first, so a freed platform is counted from the next time tick.
  */
-void update_train_stations(int direction_index, int num_stations, int **train_stations, struct train_type trains[]) {
+void update_platforms(int *platforms[], int waiting_counts[], int first_platform, int last_platform, struct train_store *trains) {
     int i;
     int train_index;
-    for (i = 0 ; i < num_stations; i++) {
-        train_index = train_stations[direction_index][i];
-        if (train_index >= 0 && trains[train_index].loading_time == FINISHED_LOADING) {
-            train_stations[direction_index][i] = READY_TO_LOAD; 
+    for (i = first_platform; i < last_platform; i++) {
+        train_index = *platforms[i];
+        if (train_index == READY_TO_LOAD) {
+            waiting_counts[i - first_platform]++;
+        } else if (train_index >= 0 && trains->loading_time[train_index] == FINISHED_LOADING) {
+            *platforms[i] = READY_TO_LOAD;
         }
     }
 }
-void update_links_status(int **links_status_update, int **links_status, int S) {
+/**
+ * Frees up the links of the trains that arrived in this time tick. Only the freed links are visited.
+ */
+void update_links_status(int freed_links[], int num_freed_links, int links_status[]) {
     int i;
-    int j;
+    for (i = 0; i < num_freed_links; i++) {
+        links_status[freed_links[i]] = LINK_IS_EMPTY;
+    }
+}
+// Functions: Event engine
+void init_event_engine(struct event_engine *engine, int num_trains, int num_links, int S, struct route_table routes[]) {
+    int i;
+    int line;
+    int direction;
+    init_timing_wheel(&engine->wheel, num_trains, -1);
+    engine->event = (int*)malloc(num_trains * sizeof(int));
+    for (i = 0; i < NUM_EVENTS; i++) {
+        engine->due_trains[i] = (int*)malloc(num_trains * sizeof(int));
+        engine->num_due[i] = 0;
+    }
+    engine->link_claimers = (int*)malloc(num_trains * sizeof(int));
+    engine->station_claimers = (int*)malloc(num_trains * sizeof(int));
+    engine->freed_links = (int*)malloc(num_trains * sizeof(int));
+    for (line = 0; line < 3; line++) {
+        for (direction = 0; direction < 2; direction++) {
+            engine->ready_since[line][direction] = (int*)malloc(routes[line].num_stations * sizeof(int));
+            for (i = 0; i < routes[line].num_stations; i++) {
+                engine->ready_since[line][direction][i] = -1;
+            }
+        }
+    }
+    engine->queue_next = (int*)malloc(num_trains * sizeof(int));
+    engine->link_queues = (struct wait_queue*)malloc(num_links * sizeof(struct wait_queue));
+    engine->station_queues = (struct wait_queue*)malloc(S * sizeof(struct wait_queue));
+    for (i = 0; i < num_links; i++) {
+        engine->link_queues[i].head = WHEEL_NONE;
+        engine->link_queues[i].tail = WHEEL_NONE;
+    }
     for (i = 0; i < S; i++) {
-        for (j = 0; j < S; j ++) {
-            if (links_status_update[i][j] == FREE_THIS_LINK) {
-                links_status[i][j] = LINK_IS_EMPTY;
-                links_status_update[i][j] = LINK_DEFAULT_STATUS;
+        engine->station_queues[i].head = WHEEL_NONE;
+        engine->station_queues[i].tail = WHEEL_NONE;
+    }
+}
+void free_event_engine(struct event_engine *engine) {
+    int i;
+    int line;
+    int direction;
+    free_timing_wheel(&engine->wheel);
+    free(engine->event);
+    for (i = 0; i < NUM_EVENTS; i++) {
+        free(engine->due_trains[i]);
+    }
+    free(engine->link_claimers);
+    free(engine->station_claimers);
+    free(engine->freed_links);
+    for (line = 0; line < 3; line++) {
+        for (direction = 0; direction < 2; direction++) {
+            free(engine->ready_since[line][direction]);
+        }
+    }
+    free(engine->queue_next);
+    free(engine->link_queues);
+    free(engine->station_queues);
+}
+void schedule_train_event(struct event_engine *engine, int train_number, int event, int time_tick) {
+    engine->event[train_number] = event;
+    schedule_event(&engine->wheel, train_number, time_tick);
+}
+/**
+ * Schedules the end of the loading of a train that started loading in this time tick. The loading time counts down from
+ * the next tick and the platform is freed in the tick it reaches 0, which may be this tick.
+ */
+void schedule_loading(struct event_engine *engine, struct train_store *trains, int train_number, int time_tick) {
+    if (trains->loading_time[train_number] == FINISHED_LOADING) {
+        engine->due_trains[EVENT_LOAD_DONE][engine->num_due[EVENT_LOAD_DONE]++] = train_number;
+    } else {
+        schedule_train_event(engine, train_number, EVENT_LOAD_DONE, time_tick + trains->loading_time[train_number]);
+    }
+}
+/**
+ * Keeps the waiting time of a platform without counting it every tick. The ticks in which the platform is ready to load
+ * are added up when it stops being ready. from_tick is the first tick from which the current value of the platform counts.
+ */
+void sync_platform_waiting_time(int platform, int *ready_since, int *waiting_time, int from_tick) {
+    if (platform == READY_TO_LOAD && *ready_since < 0) {
+        *ready_since = from_tick;
+    } else if (platform != READY_TO_LOAD && *ready_since >= 0) {
+        *waiting_time += from_tick - *ready_since;
+        *ready_since = -1;
+    }
+}
+/**
+ * Parks a train at the back of a wait queue. A parked train has no pending event until the queue is drained.
+ */
+void park_train(struct event_engine *engine, struct wait_queue *queue, int train_number) {
+    engine->queue_next[train_number] = WHEEL_NONE;
+    if (queue->tail == WHEEL_NONE) {
+        queue->head = train_number;
+    } else {
+        engine->queue_next[queue->tail] = train_number;
+    }
+    queue->tail = train_number;
+}
+/**
+ * Empties a wait queue and returns its first train. The other trains follow in FIFO order through queue_next.
+ */
+int drain_queue(struct wait_queue *queue) {
+    int head = queue->head;
+    queue->head = WHEEL_NONE;
+    queue->tail = WHEEL_NONE;
+    return head;
+}
+/**
+ * Single threaded engine that only handles the trains with an event due in each time tick, in the same phases as the
+ * tick engine. The loading and transit times of the trains are not counted down, only set when the train starts loading
+ * or boards a link.
+ * A train whose link is in use waits in the queue of the link. The whole queue tries again in the tick after the link is
+ * released, and the lowest train index wins as in the tick engine; the others go back to the queue, since the link is in
+ * use again. A train that finds its station loading (or loses it) waits in the queue of the station, and the whole queue
+ * tries again in phase C of the tick in which a train leaves the station.
+ */
+void run_event_engine(struct train_store *trains, int num_trains, int num_links, int S, int line_start[], int line_end[], struct route_table routes[], int **line_platforms[], int **line_waiting_times[], double all_stations_popularity_list[], int links_status[], int station_status[], struct train_intent intents[], long long link_claims[], long long station_claims[], int N, uint64_t seed, struct trace_mode *mode, struct trace_writer *writer) {
+    int i;
+    int j;
+    int line;
+    int direction;
+    int time_tick;
+    struct event_engine engine;
+    int moved_since_trace = 1;
+    init_event_engine(&engine, num_trains, num_links, S, routes);
+
+    for (time_tick = 0; time_tick < N; time_tick++) {
+        int moved = time_tick == 0;
+        int train_number;
+        // Sort the trains due in this tick by their event.
+        for (i = 0; i < NUM_EVENTS; i++) {
+            engine.num_due[i] = 0;
+        }
+        engine.num_link_claimers = 0;
+        engine.num_station_claimers = 0;
+        engine.num_freed_links = 0;
+        train_number = advance_timing_wheel(&engine.wheel);
+        while (train_number != WHEEL_NONE) {
+            int next = engine.wheel.next[train_number];
+            int event = engine.event[train_number];
+            engine.due_trains[event][engine.num_due[event]++] = train_number;
+            train_number = next;
+        }
+
+        // PHASE A: Enter the network. The k-th train of a line enters in tick k / 2, at the start of the line if k is even.
+        for (line = 0; line < 3; line++) {
+            struct route_table *route = &routes[line];
+            if (time_tick > (line_end[line] - line_start[line]) / 2) {
+                continue;
+            }
+            for (i = line_start[line] + 2 * time_tick; i < line_end[line] && i < line_start[line] + 2 * time_tick + 2; i++) {
+                int starting_station = (i - line_start[line]) % 2 == 0 ? 0 : route->num_stations - 1;
+                introduce_train_into_network(trains, i, all_stations_popularity_list, line_platforms[line], route, starting_station, seed, time_tick);
+                direction = trains->direction[i];
+                sync_platform_waiting_time(line_platforms[line][direction][starting_station], &engine.ready_since[line][direction][starting_station], &line_waiting_times[line][direction][starting_station], time_tick);
+                if (trains->loading_time[i] == WAITING_TO_LOAD) {
+                    schedule_train_event(&engine, i, EVENT_LOAD_TRY, time_tick + 1);
+                } else {
+                    schedule_loading(&engine, trains, i, time_tick);
+                }
+                moved = 1;
+            }
+        }
+        // PHASE A: Arrive at the next station.
+        for (j = 0; j < engine.num_due[EVENT_ARRIVE]; j++) {
+            i = engine.due_trains[EVENT_ARRIVE][j];
+            line = trains->line[i];
+            struct route_table *route = &routes[line];
+            trains->transit_time[i] = 0;
+            in_transit_action(trains, i, route, line_platforms[line], engine.freed_links, &engine.num_freed_links, time_tick);
+            direction = trains->direction[i];
+            sync_platform_waiting_time(line_platforms[line][direction][trains->station[i]], &engine.ready_since[line][direction][trains->station[i]], &line_waiting_times[line][direction][trains->station[i]], time_tick);
+            schedule_train_event(&engine, i, EVENT_LOAD_TRY, time_tick + 1);
+            moved = 1;
+        }
+        // PHASE A: Post intents for links.
+        for (j = 0; j < engine.num_due[EVENT_DEPART]; j++) {
+            i = engine.due_trains[EVENT_DEPART][j];
+            struct route_table *route = &routes[trains->line[i]];
+            in_station_action(trains, i, route, links_status, link_claims, &intents[i], time_tick);
+            if (intents[i].link != NO_INTENT) {
+                engine.link_claimers[engine.num_link_claimers++] = i;
+            } else {
+                park_train(&engine, &engine.link_queues[route->link[trains->direction[i]][trains->station[i]]], i);
+            }
+        }
+        // PHASE B: Resolve the intents for links.
+        for (j = 0; j < engine.num_link_claimers; j++) {
+            i = engine.link_claimers[j];
+            struct route_table *route = &routes[trains->line[i]];
+            int link = route->link[trains->direction[i]][trains->station[i]];
+            resolve_link_intent(trains, i, route, links_status, station_status, link_claims, &intents[i], time_tick);
+            if (trains->status[i] != IN_TRANSIT) {
+                park_train(&engine, &engine.link_queues[link], i);
+                continue;
+            }
+            // The station the train left is ready to load, so the trains waiting for it try in phase C of this tick.
+            train_number = drain_queue(&engine.station_queues[route->station[trains->station[i]]]);
+            while (train_number != WHEEL_NONE) {
+                engine.due_trains[EVENT_LOAD_TRY][engine.num_due[EVENT_LOAD_TRY]++] = train_number;
+                train_number = engine.queue_next[train_number];
+            }
+            // A link with a transit time of 1 never counts down to 0 in the tick engine, so the train stays in transit.
+            if (trains->transit_time[i] > 0) {
+                schedule_train_event(&engine, i, EVENT_ARRIVE, time_tick + trains->transit_time[i]);
+            }
+            moved = 1;
+        }
+        // PHASE C: Post intents for stations.
+        for (j = 0; j < engine.num_due[EVENT_LOAD_TRY]; j++) {
+            i = engine.due_trains[EVENT_LOAD_TRY][j];
+            struct route_table *route = &routes[trains->line[i]];
+            post_station_intent(trains, i, route, station_status, station_claims, &intents[i], time_tick);
+            if (intents[i].station != NO_INTENT) {
+                engine.station_claimers[engine.num_station_claimers++] = i;
+            } else {
+                park_train(&engine, &engine.station_queues[route->station[trains->station[i]]], i);
+            }
+        }
+        // PHASE D: Resolve the intents for stations.
+        for (j = 0; j < engine.num_station_claimers; j++) {
+            i = engine.station_claimers[j];
+            line = trains->line[i];
+            resolve_station_intent(trains, i, line_platforms[line], all_stations_popularity_list, station_status, station_claims, &intents[i], seed, time_tick);
+            if (trains->loading_time[i] == WAITING_TO_LOAD) {
+                park_train(&engine, &engine.station_queues[routes[line].station[trains->station[i]]], i);
+                continue;
+            }
+            direction = trains->direction[i];
+            sync_platform_waiting_time(line_platforms[line][direction][trains->station[i]], &engine.ready_since[line][direction][trains->station[i]], &line_waiting_times[line][direction][trains->station[i]], time_tick);
+            schedule_loading(&engine, trains, i, time_tick);
+        }
+        // Free up the platforms of the trains that finished loading, and the links of the trains that arrived.
+        for (j = 0; j < engine.num_due[EVENT_LOAD_DONE]; j++) {
+            i = engine.due_trains[EVENT_LOAD_DONE][j];
+            line = trains->line[i];
+            direction = trains->direction[i];
+            int *platform = &line_platforms[line][direction][trains->station[i]];
+            trains->loading_time[i] = FINISHED_LOADING;
+            if (*platform == i) {
+                *platform = READY_TO_LOAD;
+                sync_platform_waiting_time(*platform, &engine.ready_since[line][direction][trains->station[i]], &line_waiting_times[line][direction][trains->station[i]], time_tick + 1);
+            }
+            schedule_train_event(&engine, i, EVENT_DEPART, time_tick + 1);
+        }
+        update_links_status(engine.freed_links, engine.num_freed_links, links_status);
+        // The trains waiting for a released link try in the next tick.
+        for (j = 0; j < engine.num_freed_links; j++) {
+            train_number = drain_queue(&engine.link_queues[engine.freed_links[j]]);
+            while (train_number != WHEEL_NONE) {
+                int next = engine.queue_next[train_number];
+                schedule_train_event(&engine, train_number, EVENT_DEPART, time_tick + 1);
+                train_number = next;
             }
         }
+        // Hand the positions to the trace writer, or only the tick if no train moved since the last traced tick and no
+        // keyframe is due.
+        moved_since_trace |= moved;
+        if (mode->is_traced_tick(mode, time_tick)) {
+            if (moved_since_trace || trace_keyframe_due(writer, time_tick)) {
+                struct trace_slot *slot = begin_trace_tick(writer, time_tick);
+                slot->segment_length[0] = write_train_positions(writer, slot, trains, 0, num_trains, routes, line_end[GREEN], line_end[YELLOW] - line_end[GREEN], slot->segment[0]);
+                end_trace_tick(writer);
+            } else {
+                repeat_trace_tick(writer, time_tick);
+            }
+            moved_since_trace = 0;
+        }
     }
+    // Add up the waiting time of the platforms that are still ready to load.
+    for (line = 0; line < 3; line++) {
+        for (direction = 0; direction < 2; direction++) {
+            for (i = 0; i < routes[line].num_stations; i++) {
+                if (engine.ready_since[line][direction][i] >= 0) {
+                    line_waiting_times[line][direction][i] += N - engine.ready_since[line][direction][i];
+                }
+            }
+        }
+    }
+    free_event_engine(&engine);
 }
+
 // Functions: Calculating waiting time
 double get_average_waiting_time(int num_stations, int **station_waiting_times, int N) {
     int i;
@@ -244,93 +730,126 @@ void get_longest_shortest_average_waiting_time(int num_stations, int **station_w
 }
 
 // Functions: Helper functions
-void print_output(int iteration, struct train_type trains[], int num_trains, char *G[], char *Y[], char *B[], int num_green_trains, int num_yellow_trains, int num_blue_trains, char *all_stations_list[], int num_all_stations, int num_green_stations, int num_yellow_stations, int num_blue_stations, FILE* fp) {
+/**
+ * Formats the log tokens of the trains from first_train to last_train into out, and returns their length.
+ */
+int format_train_positions(struct train_store *trains, int first_train, int last_train, struct route_table routes[], int num_green_trains, int num_yellow_trains, char *out) {
     int i;
+    char *end = out;
+    struct route_table *route;
+    char line_letter;
     int train_index;
-    int current_station_index;
-    int prev_station_index;
-
-    fprintf(fp, "%d:", iteration);
-    // Print satus of all green trains first
-    for (i = 0; i < num_green_trains; i++) {
-        if (trains[i].status == NOT_IN_NETWORK) {
+    for (i = first_train; i < last_train; i++) {
+        if (trains->status[i] == NOT_IN_NETWORK) {
             continue;
         }
-        else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, G, all_stations_list);
-            fprintf(fp, " g%d-s%d,", i, current_station_index);
-        } 
-        else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, G, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_green_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, G, all_stations_list);
-            fprintf(fp, " g%d-s%d->s%d,", i, prev_station_index, current_station_index);
-        }
-    }
-
-    // Yellow
-    for (i = num_green_trains; i < num_green_trains + num_yellow_trains; i++) {
-        train_index = i - num_green_trains;
-        if (trains[i].status == NOT_IN_NETWORK) {
-            continue;
+        if (i < num_green_trains) {
+            route = &routes[GREEN];
+            line_letter = 'g';
+            train_index = i;
+        } else if (i < num_green_trains + num_yellow_trains) {
+            route = &routes[YELLOW];
+            line_letter = 'y';
+            train_index = i - num_green_trains;
+        } else {
+            route = &routes[BLUE];
+            line_letter = 'b';
+            train_index = i - num_green_trains - num_yellow_trains;
         }
-        else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, Y, all_stations_list);
-            fprintf(fp, " y%d-s%d,", train_index, current_station_index);
-        } else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, Y, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_yellow_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, Y, all_stations_list);
-            fprintf(fp, " y%d-s%d->s%d,", train_index, prev_station_index, current_station_index);
+        if (trains->status[i] == IN_STATION) {
+            end = append_train_position(end, line_letter, train_index, route->station[trains->station[i]], TRACE_IN_STATION);
+        } else {
+            end = append_train_position(end, line_letter, train_index, route->station[trains->station[i]], route->next_global_station[trains->direction[i]][trains->station[i]]);
         }
     }
-
-    for (i = num_green_trains + num_yellow_trains; i < num_trains; i++) {
-        train_index = i - num_green_trains - num_yellow_trains;
-        if (trains[i].status == NOT_IN_NETWORK) {
-            continue;
-        }
-        else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, B, all_stations_list);
-            fprintf(fp, " b%d-s%d,", train_index, current_station_index);
-        } else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, B, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_blue_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, B, all_stations_list);
-            fprintf(fp, " b%d-s%d->s%d,", train_index, prev_station_index, current_station_index);
+    return end - out;
+}
+/**
+ * State of a train in the binary trace (see train_trace.h).
+ */
+unsigned int pack_train_state(struct train_store *trains, int train_number) {
+    if (trains->status[train_number] == NOT_IN_NETWORK) {
+        return 0;
+    }
+    return 1 + ((trains->station[train_number] << 2) | (trains->direction[train_number] << 1) | (trains->status[train_number] == IN_TRANSIT));
+}
+/**
+ * Packs the states of the trains from first_train to last_train into out as varints, and returns their length.
+ */
+int pack_train_states(struct train_store *trains, int first_train, int last_train, char *out) {
+    int i;
+    char *end = out;
+    for (i = first_train; i < last_train; i++) {
+        end = append_varint(end, pack_train_state(trains, i));
+    }
+    return end - out;
+}
+/**
+ * Packs the (train, state) of the trains from first_train to last_train that moved in time_tick into out, and returns
+ * their length. The moves are the ones stamped in changed_tick by the state transitions (entering the network, arriving
+ * and boarding, and also starting to load, which the trace does not need but costs one pair).
+ */
+int pack_train_changes(struct train_store *trains, int first_train, int last_train, int time_tick, char *out) {
+    int i;
+    char *end = out;
+    for (i = first_train; i < last_train; i++) {
+        if (trains->changed_tick[i] == time_tick) {
+            end = append_varint(end, i);
+            end = append_varint(end, pack_train_state(trains, i));
         }
     }
-    fprintf(fp, "\n");
+    return end - out;
+}
+/**
+ * Fills a segment of a trace slot with the trains from first_train to last_train, in the format of the writer.
+ */
+int write_train_positions(struct trace_writer *writer, struct trace_slot *slot, struct train_store *trains, int first_train, int last_train, struct route_table routes[], int num_green_trains, int num_yellow_trains, char *out) {
+    if (writer->format == TRACE_FORMAT_TEXT) {
+        return format_train_positions(trains, first_train, last_train, routes, num_green_trains, num_yellow_trains, out);
+    }
+    if (slot->delta) {
+        return pack_train_changes(trains, first_train, last_train, slot->time_tick, out);
+    }
+    return pack_train_states(trains, first_train, last_train, out);
+}
+/**
+ * Opens the trace writer with num_segments segments of segment_trains trains, and writes the header of a binary trace.
+ */
+void start_trace(struct trace_writer *writer, FILE *fp, FILE *index_fp, struct run_options *options, struct trace_mode *mode, struct trace_header *header, int num_segments, int segment_trains) {
+    open_trace_writer(writer, fp, index_fp, options->compress, options->trace, options->keyframe_interval, mode->first_tick, mode->tick_step, num_segments, segment_trains);
+    if (options->trace != TRACE_FORMAT_TEXT) {
+        write_trace_header(writer, header);
+    }
 }
 int change_train_direction(int direction)  {
     direction += 1;
     return direction % 2;
 }
-void print_status(struct train_type trains[], int num_all_trains, char *line_station_names[], int num_stations, int line) {
+void print_status(struct train_store *trains, int num_all_trains, char *line_station_names[], int num_stations, int line) {
     int i;
     printf("\n~~~~~~~~~~ TRAIN STATUS ~~~~~~~~~~~\n");
     for (i = 0; i < num_all_trains; i++) {
-        if (trains[i].line != line){
+        if (trains->line[i] != line){
             continue;
         }
         char *direction;
-        if (trains[i].direction == LEFT) {
+        if (trains->direction[i] == LEFT) {
             direction = "Left";
         } else {
             direction = "Right";
         }
-        if (trains[i].status == IN_STATION && trains[i].loading_time == WAITING_TO_LOAD)
+        if (trains->status[i] == IN_STATION && trains->loading_time[i] == WAITING_TO_LOAD)
         {
-            printf("Train %d is currently in (%s) station %d | Waiting to load...\n", i, direction, trains[i].station);
+            printf("Train %d is currently in (%s) station %d | Waiting to load...\n", i, direction, trains->station[i]);
         }
-        else if (trains[i].status == IN_STATION) {
-            printf("Train %d is currently in (%s) station %d | With %d ticks left to load\n", i, direction, trains[i].station, trains[i].loading_time);
+        else if (trains->status[i] == IN_STATION) {
+            printf("Train %d is currently in (%s) station %d | With %d ticks left to load\n", i, direction, trains->station[i], trains->loading_time[i]);
         }
-        else if (trains[i].status == IN_TRANSIT)
+        else if (trains->status[i] == IN_TRANSIT)
         {
-            int current_station = trains[i].station;
-            int next_station = get_next_station(current_station, trains[i].direction, num_stations);
-            printf("Train %d is currently in transit %s->%s | With %d ticks left to transit.\n", i, line_station_names[current_station], line_station_names[next_station], trains[i].transit_time);
+            int current_station = trains->station[i];
+            int next_station = get_next_station(current_station, trains->direction[i], num_stations);
+            printf("Train %d is currently in transit %s->%s | With %d ticks left to transit.\n", i, line_station_names[current_station], line_station_names[next_station], trains->transit_time[i]);
         }
     }
 }
@@ -351,26 +870,153 @@ int get_next_station(int prev_station, int direction, int num_stations) {
     }
     return prev_station - 1;
 }
-int get_all_station_index(int num_stations, int line_station_index, char *line_stations[], char *all_stations_list[]) {
-    for (int i = 0; i < num_stations; i++) {   
-        if (strcmp(line_stations[line_station_index], all_stations_list[i]) == 0) {
-            return i;
+/**
+ * Atomically sets the slot to desired if it still holds expected. Returns 1 if the slot was claimed by this call.
+ * Used for the platforms of a line, which an arriving train and an entering train may update in the same phase.
+ */
+int claim_slot(int *slot, int expected, int desired) {
+    return __atomic_compare_exchange_n(slot, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+/**
+ * A claim holds the time tick in the upper 32 bits and the lowest index of the trains that asked for it in the lower 32 bits.
+ * Claims from earlier time ticks count as empty, so they never have to be reset. The result does not depend on the order
+ * in which the trains post their claims.
+ */
+void post_claim(long long *claim, int time_tick, int train_number) {
+    long long desired = ((long long)time_tick << 32) | (unsigned int)train_number;
+    long long current = __atomic_load_n(claim, __ATOMIC_ACQUIRE);
+    while ((current >> 32) != time_tick || current > desired) {
+        if (__atomic_compare_exchange_n(claim, &current, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return;
         }
     }
-
-    for (int i = 0; i < num_stations; i++) {   
-        if (strcmp(line_stations[line_station_index], all_stations_list[i]) == 0) {
-            return i;
+}
+int won_claim(long long *claim, int time_tick, int train_number) {
+    return *claim == (((long long)time_tick << 32) | (unsigned int)train_number);
+}
+/**
+ * Parses the command line options.
+ * --threads=N | -t N: Number of OpenMP threads. Defaults to OMP_NUM_THREADS, or the number of processors if it is not set.
+ * --input=FILE: Network to simulate, in any format of train_input.h (a snapshot too). Defaults to input.txt.
+ * --seed=N: Seed of the loading times. Runs with the same seed give the same output for any number of threads.
+ * --engine=tick|event: Tick every train in every time tick (default), or only handle the trains with an event due.
+ * --trace=text|bin|delta, --keyframe=N, --compress: Format of the trace (see train_trace.h).
+ * --sample=K | --window=T0:T1 | --summary: Trace every K-th time tick, time ticks T0 to T1, or no time tick at all (only
+ * the average waiting times are written to log.txt). Every time tick is traced by default.
+ */
+void parse_run_options(int argc, char *argv[], struct run_options *options) {
+    int i;
+    options->num_threads = omp_get_max_threads();
+    options->seed = RNG_DEFAULT_SEED;
+    options->input_name = "input.txt";
+    options->engine = ENGINE_TICK;
+    options->trace = TRACE_FORMAT_TEXT;
+    options->keyframe_interval = TRACE_KEYFRAME_INTERVAL;
+    options->compress = 0;
+    options->run_mode = RUN_FULL;
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options->num_threads = atoi(argv[i] + 10);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options->num_threads = atoi(argv[++i]);
+        } else if (strncmp(argv[i], "--input=", 8) == 0) {
+            options->input_name = argv[i] + 8;
+        } else if (strncmp(argv[i], "--seed=", 7) == 0) {
+            options->seed = strtoull(argv[i] + 7, NULL, 10);
+        } else if (strcmp(argv[i], "--engine=tick") == 0) {
+            options->engine = ENGINE_TICK;
+        } else if (strcmp(argv[i], "--engine=event") == 0) {
+            options->engine = ENGINE_EVENT;
+        } else if (strcmp(argv[i], "--trace=text") == 0) {
+            options->trace = TRACE_FORMAT_TEXT;
+        } else if (strcmp(argv[i], "--trace=bin") == 0) {
+            options->trace = TRACE_FORMAT_BINARY;
+        } else if (strcmp(argv[i], "--trace=delta") == 0) {
+            options->trace = TRACE_FORMAT_DELTA;
+        } else if (strncmp(argv[i], "--keyframe=", 11) == 0) {
+            options->keyframe_interval = atoi(argv[i] + 11);
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            options->compress = 1;
+        } else if (strncmp(argv[i], "--sample=", 9) == 0) {
+            options->run_mode = RUN_SAMPLED;
+            options->sample_step = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--window=", 9) == 0) {
+            options->run_mode = RUN_WINDOW;
+            if (sscanf(argv[i] + 9, "%d:%d", &options->window_first, &options->window_last) != 2) {
+                printf("Error! The window must be given as --window=T0:T1\n");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--summary") == 0) {
+            options->run_mode = RUN_SUMMARY;
+        } else {
+            printf("Error! Unknown option %s\n", argv[i]);
+            exit(1);
         }
     }
-    // printf("WEIRD: Query - %s to size %d all_stations_list", line_stations[line_station_index], num_stations);
-}
-int calculate_loadtime(double popularity) {
-    double random_number;
-    random_number = (rand() % 10) + 1;
-    return ceil(random_number * popularity);
+    if (options->num_threads < 1) {
+        printf("Error! Number of threads must be at least 1\n");
+        exit(1);
+    }
+    if (options->keyframe_interval < 1) {
+        printf("Error! Keyframe interval must be at least 1\n");
+        exit(1);
+    }
+    if (options->run_mode == RUN_SAMPLED && options->sample_step < 1) {
+        printf("Error! Sample step must be at least 1\n");
+        exit(1);
+    }
+    if (options->run_mode == RUN_WINDOW && (options->window_first < 0 || options->window_last < options->window_first)) {
+        printf("Error! Window %d:%d is not a range of time ticks\n", options->window_first, options->window_last);
+        exit(1);
+    }
+    if (options->run_mode == RUN_SUMMARY && options->compress) {
+        printf("Error! A summary-only run has no trace to compress\n");
+        exit(1);
+    }
 }
 
+int trace_every_tick(struct trace_mode *mode, int time_tick) {
+    (void)mode;
+    (void)time_tick;
+    return 1;
+}
+int trace_sampled_tick(struct trace_mode *mode, int time_tick) {
+    return time_tick % mode->tick_step == 0;
+}
+int trace_window_tick(struct trace_mode *mode, int time_tick) {
+    return time_tick >= mode->first_tick && time_tick < mode->first_tick + mode->num_ticks;
+}
+int trace_no_tick(struct trace_mode *mode, int time_tick) {
+    (void)mode;
+    (void)time_tick;
+    return 0;
+}
+/**
+ * Picks the time ticks to trace for the run mode, over a run of N time ticks.
+ */
+void init_trace_mode(struct trace_mode *mode, struct run_options *options, int N) {
+    mode->first_tick = 0;
+    mode->tick_step = 1;
+    mode->num_ticks = N;
+    if (options->run_mode == RUN_FULL) {
+        mode->is_traced_tick = trace_every_tick;
+    } else if (options->run_mode == RUN_SAMPLED) {
+        mode->is_traced_tick = trace_sampled_tick;
+        mode->tick_step = options->sample_step;
+        mode->num_ticks = (N + options->sample_step - 1) / options->sample_step;
+    } else if (options->run_mode == RUN_WINDOW) {
+        if (options->window_first >= N) {
+            printf("Error! Window %d:%d starts after the last time tick\n", options->window_first, options->window_last);
+            exit(1);
+        }
+        mode->is_traced_tick = trace_window_tick;
+        mode->first_tick = options->window_first;
+        mode->num_ticks = (options->window_last < N ? options->window_last + 1 : N) - options->window_first;
+    } else {
+        mode->is_traced_tick = trace_no_tick;
+        mode->num_ticks = 0;
+    }
+}
 
 int main(int argc, char *argv[]) {
     int i;
@@ -378,207 +1024,47 @@ int main(int argc, char *argv[]) {
     int k;
     int time_tick;
     int msec;
+    struct run_options options;
+    parse_run_options(argc, argv, &options);
 
     //---------------------------- PARSING INPUT FROM THE INPUT FILE. -------------------------------//
-    char c[1000];
-    FILE *fptr;
-    if ((fptr = fopen("input.txt", "r")) == NULL)
-    {
-        printf("Error! opening file");
-        // Program exits if file pointer returns NULL.
-        exit(1);         
-    }
-    fgets(c, 1000, fptr);
-    int S = atoi(c);
-   
-    // Creating all stations list.
-    fgets(c, 1000, fptr);
-    char *all_stations_list[S];
-    const char delimiter[2] = ",";
-    char *station;             // pointer to the first character of station token.
-    station = strtok(c, delimiter);
-    for (i = 0 ; i < S; i++) {
-        all_stations_list[i] = station;
-        station = strtok(NULL, delimiter);
-    }
-    // REALLOCATE THE VALUES OF ALL STATIONS LISt.
-    for (i = 0 ; i < S; i++ ){
-        char *station = all_stations_list[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        all_stations_list[i] = station_value;  
-    }
-
-    // S x S matrix denoting the link transit time.
-    int *link_transit_time[S];
-    for (i = 0 ; i < S; i++) {
-        link_transit_time[i] = (int*)malloc(S * sizeof(int));
-    }
-    const char space_delimiter[2] = " ";
-    char *value;
-    int int_value;
-    // fgets S number of times.
-    for (i = 0 ; i < S; i++) {
-        fgets(c, 1000, fptr);
-        value = strtok(c, space_delimiter);
-        int_value = atoi(value);
-        for (j = 0 ; j < S; j++) {
-            int_value = atoi(value);
-            link_transit_time[i][j] = int_value;
-            value = strtok(NULL, space_delimiter);
-        }
-    }
-   
-    // POPULARITY LIST.
-    double *all_stations_popularity_list = malloc(S * sizeof(double));
-    double double_value;
-    fgets(c, 1000, fptr);
-    value = strtok(c, space_delimiter);
-    sscanf(value, "%lf", &double_value);
-    for (i = 0 ; i < S; i++) {
-        sscanf(value, "%lf", &double_value);
-        all_stations_popularity_list[i] = double_value;
-        value = strtok(NULL, space_delimiter);
-    }
-    
-    
-    // GREEN TRAIN STATION LIST.
-    char *temp_G[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    i = 0;
-    int num_green_stations = 0;
-    while (station != NULL){
-        temp_G[num_green_stations] = station;
-        num_green_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *G[num_green_stations];
-    for (i = 0 ; i < num_green_stations; i++) {
-        G[i] = temp_G[i];
-    }
-    for (i = 0 ; i < num_green_stations; i++ ){
-        char *station = G[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        G[i] = station_value;  
-    
-    }
-
-    // YELLOW TRAIN STATION LIST
-    char *temp_Y[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    int num_yellow_stations = 0;
-    while (station != NULL){
-        temp_Y[num_yellow_stations] = station;
-        num_yellow_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *Y[num_yellow_stations];
-    for (i = 0 ; i < num_yellow_stations; i++) {
-        Y[i] = temp_Y[i];
-    }
-    for (i = 0 ; i < num_yellow_stations; i++ ){
-        char *station = Y[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        Y[i] = station_value;  
-    }
-
-    // BLUE TRAIN STATION LIST
-    char *temp_B[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    int num_blue_stations = 0;
-    while (station != NULL){
-        temp_B[num_blue_stations] = station;
-        num_blue_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *B[num_blue_stations];
-    for (i = 0 ; i < num_blue_stations; i++) {
-        B[i] = temp_B[i];
-    }
-    for (i = 0 ; i < num_blue_stations; i++ ){
-        char *station = B[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        B[i] = station_value;  
+    // The network is mapped and read in one pass, or mapped and used as it is if it is a snapshot (train_input.c). The
+    // lines come with the global index of their stations and their route tables.
+    struct network_input input;
+    if (load_network_input(&input, options.input_name) != 0) {
+        exit(1);
     }
-
-    // Get count of number of trains and close file pointer
-    fgets(c, 1000, fptr);
-    int N = atoi(c); 
-    fgets(c, 1000, fptr);
-
-    value = strtok(c, delimiter);
-    int g = atoi(value);
-    value = strtok(NULL, delimiter);
-    int y = atoi(value);
-    value = strtok(NULL, delimiter);
-    int b = atoi(value);
-    fclose(fptr);
+    int S = input.num_stations;
+    char **all_stations_list = input.station_names;
+    double *all_stations_popularity_list = input.popularity;
+    struct link_graph graph = input.graph;
+    int num_green_stations = input.num_line_stations[INPUT_GREEN];
+    int num_yellow_stations = input.num_line_stations[INPUT_YELLOW];
+    int num_blue_stations = input.num_line_stations[INPUT_BLUE];
+    int N = input.num_ticks;
+    int g = input.num_line_trains[INPUT_GREEN];
+    int y = input.num_line_trains[INPUT_YELLOW];
+    int b = input.num_line_trains[INPUT_BLUE];
   
     //---------------------------- PARSING INPUT FROM THE INPUT FILE. -------------------------------//
-    // Initialize Link status. -1: Link is empty | 1: Link is used
-    int *links_status[S];
-    for (i = 0; i < S; i++) {
-        links_status[i] = (int*)malloc(S * sizeof(int));
-    }
-    for (i = 0; i < S; i++) {
-        for (j = 0; j < S; j++) {
-            links_status[i][j] = LINK_IS_EMPTY;
-        }
+    // INITIALISATION of the route tables of each line. Indexed by the line of the train.
+    struct route_table routes[3];
+    routes[GREEN] = input.routes[INPUT_GREEN];
+    routes[YELLOW] = input.routes[INPUT_YELLOW];
+    routes[BLUE] = input.routes[INPUT_BLUE];
+    // Initialize Link status, indexed by link id. -1: Link is empty | 1: Link is used
+    int num_links = graph.num_links;
+    int *links_status = (int*)malloc(num_links * sizeof(int));
+    for (i = 0; i < num_links; i++) {
+        links_status[i] = LINK_IS_EMPTY;
     }
 
     // Initialize all trains,
     int num_all_trains = g + y + b;
-    struct train_type trains[num_all_trains];
-    struct train_type initial_green_train = {WAITING_TO_LOAD, NOT_IN_NETWORK, RIGHT, -1, -1, GREEN};
-    struct train_type initial_blue_train = {WAITING_TO_LOAD, NOT_IN_NETWORK, RIGHT, -1 , -1, BLUE};
-    struct train_type initial_yellow_train = {WAITING_TO_LOAD, NOT_IN_NETWORK, RIGHT, -1, -1, YELLOW};
-    for (i = 0; i < g; i++) {
-        trains[i] = initial_green_train;
-    }
-    for (i = g; i < g + y; i ++) {
-        trains[i] = initial_yellow_train;
-    }
-    for (i = g + y; i < g + y + b; i++) {
-        trains[i] = initial_blue_train;
-    }
+    struct train_store train_store;
+    struct train_store *trains = &train_store;
+    init_train_store(trains, g, y, b);
+    unsigned char *train_events = malloc(trains->capacity);
 
     // INITIALISATION of arrays that keep track of the status of EACH station on EACH line in EACH direction.
     // If a station is occupied, it will store the GLOBAL INDEX of the train from the trains array.
@@ -627,116 +1113,233 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // INITALISATION of 2D array to keep track of which link to free up. If an entry is 1 it means that a train just finished transitting in the link. 0 otherwise.
-    int *links_status_update[S];
-    for (i = 0; i < S; i ++) {
-        links_status_update[i] = (int*)malloc(S * sizeof(int));
-    }
-    for (i = 0; i < S; i ++) {
-        for (j = 0; j < S; j++) {
-            links_status_update[i][j] = LINK_DEFAULT_STATUS;
+    // INITIALISATION of the flat list of all platforms (line, direction, station) and their waiting times, split between
+    // the threads in phase E.
+    int num_platforms = 2 * (num_green_stations + num_yellow_stations + num_blue_stations);
+    int **platforms = (int**)malloc(num_platforms * sizeof(int*));
+    int **platform_waiting_times = (int**)malloc(num_platforms * sizeof(int*));
+    k = 0;
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < num_green_stations; j++, k++) {
+            platforms[k] = &green_stations[i][j];
+            platform_waiting_times[k] = &green_station_waiting_times[i][j];
+        }
+        for (j = 0; j < num_yellow_stations; j++, k++) {
+            platforms[k] = &yellow_stations[i][j];
+            platform_waiting_times[k] = &yellow_station_waiting_times[i][j];
         }
+        for (j = 0; j < num_blue_stations; j++, k++) {
+            platforms[k] = &blue_stations[i][j];
+            platform_waiting_times[k] = &blue_station_waiting_times[i][j];
+        }
+    }
+
+    // INITIALISATION of the intents of each train and the claims on each link and station.
+    struct train_intent *intents = malloc(num_all_trains * sizeof(struct train_intent));
+    for (i = 0; i < num_all_trains; i++) {
+        intents[i].link = NO_INTENT;
+        intents[i].station = NO_INTENT;
     }
+    long long *link_claims = malloc(num_links * sizeof(long long));
+    long long *station_claims = malloc(S * sizeof(long long));
+    for (i = 0; i < num_links; i++) {
+        link_claims[i] = NO_CLAIM;
+    }
+    for (i = 0; i < S; i++) {
+        station_claims[i] = NO_CLAIM;
+    }
+    // INITIALISATION of the next train of each line to enter the network. Trains enter in order of their index.
+    // Each time tick, next_train enters at the start of the line and next_train + 1 at the end of the line.
+    int next_train[3] = {0, g + y, g};      // Indexed by line (GREEN, BLUE, YELLOW)
+    int line_end[3] = {g, g + y + b, g + y};
 
-    // INITIALISATION of thread
-    omp_set_num_threads(num_all_trains);
+    // INITIALISATION of thread. Threads are decoupled from trains, each thread owns a fixed chunk of the trains.
+    omp_set_num_threads(options.num_threads);
 
     // INITIALISATION of logs
-    FILE* fp = fopen("log.txt", "w");
+    struct trace_mode mode;
+    init_trace_mode(&mode, &options, N);
+    // A summary-only run has no trace at all: no writer, no slots and no index, log.txt only gets the summary.
+    int summary_only = options.run_mode == RUN_SUMMARY;
+    char log_name[16];
+    char index_name[20];
+    strcpy(log_name, options.trace == TRACE_FORMAT_TEXT || summary_only ? "log.txt" : "log.bin");
+    // A compressed trace can not be seeked into, so it has no index.
+    if (options.compress) {
+        strcat(log_name, ".zst");
+    }
+    sprintf(index_name, "%s.idx", log_name);
+    FILE* fp = fopen(log_name, "wb");
+    FILE* index_fp = options.compress || summary_only ? NULL : fopen(index_name, "wb");
+    if (fp == NULL || (!options.compress && !summary_only && index_fp == NULL)) {
+        printf("Error! opening the log files\n");
+        exit(1);
+    }
+    struct trace_writer writer;
+    struct trace_slot *trace_slot = NULL;
+    int num_line_trains[3] = {g, y, b};
+    struct trace_header header = {
+        .num_ticks = mode.num_ticks,
+        .first_tick = mode.first_tick,
+        .tick_step = mode.tick_step,
+        .keyframe_interval = options.trace == TRACE_FORMAT_DELTA ? options.keyframe_interval : 1,
+        .num_stations = S,
+        .station_names = all_stations_list
+    };
+    for (i = 0; i < 3; i++) {
+        int line = i == 0 ? GREEN : (i == 1 ? YELLOW : BLUE);
+        header.num_line_trains[i] = num_line_trains[i];
+        header.num_line_stations[i] = routes[line].num_stations;
+        header.line_stations[i] = routes[line].station;
+    }
     // INITIALISATION of clock
     clock_t before = clock();
     int master_msec = 0;
-    for (time_tick = 0; time_tick < N; time_tick++) {
-        // Entering the stations 1 time tick at a time.
+    if (options.engine == ENGINE_EVENT) {
+        // The event engine formats the log in a single segment.
+        if (!summary_only) {
+            start_trace(&writer, fp, index_fp, &options, &mode, &header, 1, num_all_trains);
+        }
+        int line_start[3] = {0, g + y, g};
+        int **line_platforms[3] = {green_stations, blue_stations, yellow_stations};
+        int **line_waiting_times[3] = {green_station_waiting_times, blue_station_waiting_times, yellow_station_waiting_times};
+        run_event_engine(trains, num_all_trains, num_links, S, line_start, line_end, routes, line_platforms, line_waiting_times, all_stations_popularity_list, links_status, station_status, intents, link_claims, station_claims, N, options.seed, &mode, &writer);
+    } else {
+        // One parallel region for the whole run. Every tick, the threads update their trains in phases A to D and then wait
+        // at a barrier while the master thread does the bookkeeping for the tick.
+        #pragma omp parallel shared(green_stations, yellow_stations, blue_stations, trains, train_events, station_status, intents, link_claims, station_claims, next_train, platforms, platform_waiting_times, trace_slot, mode) private(time_tick)
+        {
         int i;
-        int j;
-        // Boolean value to make sure that only 1 train enters the line at any time tick.
-        // Introduced train keeps track of at every iteration if a train has been introduced into the line.
-        int introduced_train[2][3];
-        for (i = 0 ; i < 2; i++) {
-            for (j = 0; j < 3; j++) {
-                introduced_train[i][j] = NOT_INTRODUCED;
+        int first_train;
+        int last_train;
+        int first_platform;
+        int last_platform;
+        get_thread_chunk(num_all_trains, &first_train, &last_train);
+        get_thread_chunk(num_platforms, &first_platform, &last_platform);
+        int segment = omp_get_thread_num();
+        // The tick engine formats the log in one segment per thread. OpenMP can give the region fewer threads than asked
+        // for, so the segments are sized like the chunks of get_thread_chunk, from the threads of the team.
+        #pragma omp single
+        {
+            if (!summary_only) {
+                int num_segments = omp_get_num_threads();
+                int segment_trains = (num_all_trains + TRAINS_PER_CACHE_LINE - 1) / TRAINS_PER_CACHE_LINE;
+                segment_trains = (segment_trains + num_segments - 1) / num_segments * TRAINS_PER_CACHE_LINE;
+                start_trace(&writer, fp, index_fp, &options, &mode, &header, num_segments, segment_trains);
             }
         }
-    #pragma omp parallel for schedule(dynamic) shared(introduced_train, green_stations, yellow_stations, blue_stations, trains, station_status) private(i)
-        // Each Parallel thread will take up a train
-        for (i = 0; i < num_all_trains; i++) {
-            // Initialization of each train(thread)
-            // struct train_type trains[i] = trains[i];
-            int **line_stations;
-            char **line_stations_name_list;
-            int num_stations;
-            int *introduced_train_left;
-            int *introduced_train_right;
-            if (trains[i].line == GREEN) {
-                introduced_train_left = &introduced_train[LEFT][GREEN];
-                introduced_train_right = &introduced_train[RIGHT][GREEN];
-                line_stations = green_stations;
-                line_stations_name_list = G; 
-                num_stations = num_green_stations;
-            } else if (trains[i].line == BLUE) {
-                introduced_train_left = &introduced_train[LEFT][BLUE];
-                introduced_train_right = &introduced_train[RIGHT][BLUE];
-                line_stations = blue_stations;
-                line_stations_name_list = B;
-                num_stations = num_blue_stations;
-            } else {
-                introduced_train_left = &introduced_train[LEFT][YELLOW];
-                introduced_train_right = &introduced_train[RIGHT][YELLOW];
-                line_stations = yellow_stations;
-                line_stations_name_list = Y;
-                num_stations = num_yellow_stations;
-            }
-            // Move the train by a "tick" and update the status of the network
-            if (trains[i].status == NOT_IN_NETWORK) {
-                #pragma omp critical
-                {   
-                    introduce_train_into_network(&trains[i], all_stations_popularity_list, line_stations, line_stations_name_list, all_stations_list, num_stations, S, i, introduced_train_left, introduced_train_right);
+        // Waiting time of the platforms of this thread, added to the waiting times of the lines after the last tick.
+        int *waiting_counts = (int*)calloc(last_platform - first_platform + 1, sizeof(int));
+        // Links freed by the trains of this thread that arrived in this tick. Every train frees at most one link.
+        int *freed_links = (int*)malloc((last_train - first_train + 1) * sizeof(int));
+        int num_freed_links = 0;
+        for (time_tick = 0; time_tick < N; time_tick++) {
+            // Entering the stations 1 time tick at a time.
+            // PHASE A: Count down the loading and transit times with the vector kernel, then arrive, enter the network and
+            // post intents for links only for the trains flagged by the kernel.
+            #pragma omp master
+            {
+                // Hand the log of the previous tick to the trace writer and take a slot for this tick if it is traced.
+                if (trace_slot != NULL) {
+                    end_trace_tick(&writer);
+                    trace_slot = NULL;
+                }
+                if (mode.is_traced_tick(&mode, time_tick)) {
+                    trace_slot = begin_trace_tick(&writer, time_tick);
                 }
             }
-            else if (trains[i].status == IN_STATION) {
-                in_station_action(&trains[i], i, S, line_stations_name_list, line_stations, all_stations_list, num_stations, all_stations_popularity_list, link_transit_time, links_status, station_status);
+            countdown_trains(trains, first_train, last_train, train_events);
+            for (i = first_train; i < last_train; i++) {
+                if (!train_events[i]) {
+                    continue;
+                }
+                int line = trains->line[i];
+                struct route_table *route = &routes[line];
+                int **line_stations;
+                if (line == GREEN) {
+                    line_stations = green_stations;
+                } else if (line == BLUE) {
+                    line_stations = blue_stations;
+                } else {
+                    line_stations = yellow_stations;
+                }
+                // Move the train by a "tick" and update the status of the network
+                if (trains->status[i] == NOT_IN_NETWORK) {
+                    if (i == next_train[line]) {
+                        introduce_train_into_network(trains, i, all_stations_popularity_list, line_stations, route, 0, options.seed, time_tick);
+                    } else if (i == next_train[line] + 1) {
+                        introduce_train_into_network(trains, i, all_stations_popularity_list, line_stations, route, route->num_stations - 1, options.seed, time_tick);
+                    }
+                }
+                else if (trains->status[i] == IN_STATION) {
+                    in_station_action(trains, i, route, links_status, link_claims, &intents[i], time_tick);
+                }
+                else if (trains->status[i] == IN_TRANSIT) {
+                    in_transit_action(trains, i, route, line_stations, freed_links, &num_freed_links, time_tick);
+                }
             }
-            else if (trains[i].status == IN_TRANSIT) {
-                in_transit_action(&trains[i], num_stations, S, line_stations, line_stations_name_list, all_stations_list, links_status_update);
+            #pragma omp barrier
+            // PHASE B: Resolve the intents for links.
+            for (i = first_train; i < last_train; i++) {
+                resolve_link_intent(trains, i, &routes[trains->line[i]], links_status, station_status, link_claims, &intents[i], time_tick);
             }
-        }
-        // Master thread
-        // Count the number of idle trains at the start of each iteration. Since READY_TO_LOAD will only be accurately updated after each iteration
-        for (i = 0; i < 2; i++) {
-            char *c;
-            if (i == 0) {
-                c = "left";
-            } else {
-                c = "right";
+            #pragma omp barrier
+            // PHASE C: Post intents for stations.
+            for (i = first_train; i < last_train; i++) {
+                post_station_intent(trains, i, &routes[trains->line[i]], station_status, station_claims, &intents[i], time_tick);
             }
-            
-            for (j = 0; j < num_green_stations; j++) {
-                if (green_stations[i][j] == READY_TO_LOAD) {
-                    green_station_waiting_times[i][j] += 1;
+            #pragma omp barrier
+            // PHASE D: Resolve the intents for stations.
+            for (i = first_train; i < last_train; i++) {
+                int **line_stations;
+                if (trains->line[i] == GREEN) {
+                    line_stations = green_stations;
+                } else if (trains->line[i] == BLUE) {
+                    line_stations = blue_stations;
+                } else {
+                    line_stations = yellow_stations;
                 }
+                resolve_station_intent(trains, i, line_stations, all_stations_popularity_list, station_status, station_claims, &intents[i], options.seed, time_tick);
             }
-            for (j = 0; j < num_yellow_stations; j++) {
-                if (yellow_stations[i][j] == READY_TO_LOAD) {
-                    yellow_station_waiting_times[i][j] += 1;
-                }
+            #pragma omp barrier
+            // PHASE E: Count and free up the platforms of this thread, and release the links its trains arrived from.
+            update_platforms(platforms, waiting_counts, first_platform, last_platform, trains);
+            update_links_status(freed_links, num_freed_links, links_status);
+            num_freed_links = 0;
+            // Format the log of the trains of this thread, the writer puts the segments together in thread order.
+            if (trace_slot != NULL) {
+                trace_slot->segment_length[segment] = write_train_positions(&writer, trace_slot, trains, first_train, last_train, routes, g, y, trace_slot->segment[segment]);
             }
-            for (j = 0; j < num_blue_stations; j++) {
-                if (blue_stations[i][j] == READY_TO_LOAD) {
-                    blue_station_waiting_times[i][j] += 1;
+            // Master thread
+            #pragma omp master
+            {
+                // Move on to the trains that enter the network in the next tick.
+                for (i = 0; i < 3; i++) {
+                    while (next_train[i] < line_end[i] && trains->status[next_train[i]] != NOT_IN_NETWORK) {
+                        next_train[i]++;
+                    }
                 }
             }
+            #pragma omp barrier
+        }
+        #pragma omp master
+        {
+            if (trace_slot != NULL) {
+                end_trace_tick(&writer);
+            }
         }
-        // Free up stations where the loading train has just finished loading up passengers.
-        for (i = 0 ; i < 2; i++) {
-            update_train_stations(i, num_green_stations, green_stations, trains);
-            update_train_stations(i, num_blue_stations, blue_stations, trains);
-            update_train_stations(i, num_yellow_stations, yellow_stations, trains);
+        for (i = first_platform; i < last_platform; i++) {
+            *platform_waiting_times[i] += waiting_counts[i - first_platform];
         }
-        // Free up the links which were just used by trains if any.
-        update_links_status(links_status_update, links_status, S);
-        // Print logs to file
-       print_output(time_tick, trains, num_all_trains, G, Y, B, g, y, b, all_stations_list, S, num_green_stations, num_yellow_stations, num_blue_stations, fp);
+        free(waiting_counts);
+        free(freed_links);
+        }
+    }
+    if (!summary_only) {
+        close_trace_writer(&writer);
+    }
+    if (index_fp != NULL) {
+        fclose(index_fp);
     }
     // Close clock for time
     clock_t difference = clock() - before;
@@ -759,10 +1362,22 @@ int main(int argc, char *argv[]) {
     double blue_average_waiting_time = get_average_waiting_time(num_blue_stations, blue_station_waiting_times, N);
     get_longest_shortest_average_waiting_time(num_blue_stations, blue_station_waiting_times, N, &blue_longest_average_waiting_time, &blue_shortest_average_waiting_time);
     
-    fprintf(fp, "\nAverage waiting times:\n");
-    fprintf(fp, "green: %d trains -> %lf, %lf, %lf\n", g, green_average_waiting_time, green_longest_average_waiting_time, green_shortest_average_waiting_time);
-    fprintf(fp, "yellow: %d trains -> %lf, %lf, %lf\n", y, yellow_average_waiting_time, yellow_longest_average_waiting_time, yellow_shortest_average_waiting_time);
-    fprintf(fp, "blue: %d trains -> %lf, %lf, %lf", b, blue_average_waiting_time, blue_longest_average_waiting_time, blue_shortest_average_waiting_time);
+    // The summary ends the trace, through the writer so that it is compressed with the rest.
+    char *summary;
+    size_t summary_size;
+    FILE *summary_fp = open_memstream(&summary, &summary_size);
+    fprintf(summary_fp, "\nAverage waiting times:\n");
+    fprintf(summary_fp, "green: %d trains -> %lf, %lf, %lf\n", g, green_average_waiting_time, green_longest_average_waiting_time, green_shortest_average_waiting_time);
+    fprintf(summary_fp, "yellow: %d trains -> %lf, %lf, %lf\n", y, yellow_average_waiting_time, yellow_longest_average_waiting_time, yellow_shortest_average_waiting_time);
+    fprintf(summary_fp, "blue: %d trains -> %lf, %lf, %lf", b, blue_average_waiting_time, blue_longest_average_waiting_time, blue_shortest_average_waiting_time);
+    fclose(summary_fp);
+    if (summary_only) {
+        fwrite(summary, 1, summary_size, fp);
+    } else {
+        write_trace_data(&writer, summary, summary_size);
+        finish_trace_writer(&writer);
+    }
+    free(summary);
 
     // Close file for logs
     fclose(fp);
@@ -5,6 +5,9 @@
 #include <math.h>
 #include <time.h>
 #include <mpi.h>
+#include "train_network.h"
+#include "train_input.h"
+#include "train_rng.h"
 
 // Train Status
 #define IN_TRANSIT 1
@@ -68,29 +71,27 @@ struct train_type
 int myid;
 
 // Function declaration: Updating network
-void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, char *line_stations_name_list[], char *all_stations_list[], int num_stations, int num_network_train_stations, int train_number, int *introduced_train_left, int *introduced_train_right);
+void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, struct route_table *route, int train_number, int *introduced_train_left, int *introduced_train_right, int time_tick);
 
 // Function declaration: Calculating waiting time
 double get_average_waiting_time(int num_green_stations, int **green_station_waiting_times, int N);
 void get_longest_shortest_average_waiting_time(int num_green_stations, int **green_station_waiting_times, int N, double *longest_average_waiting_time, double *shortest_average_waiting_time);
 
 // Function declaration: Helper functions
-int calculate_loadtime(double popularity);
-int get_all_station_index(int num_all_stations, int line_station_index, char *line_stations[], char *all_stations_list[]);
 int get_next_station(int prev_station, int direction, int num_stations);
-void print_output(int iteration, struct train_type trains[], int num_trains, char *G[], char *Y[], char *B[], int num_green_trains, int num_yellow_trains, int num_blue_trains, char *all_stations_list[], int num_all_stations, int num_green_stations, int num_yellow_stations, int num_blue_stations, FILE* fp);
+void print_output(int iteration, struct train_type trains[], int num_trains, struct route_table routes[], int num_green_trains, int num_yellow_trains, FILE* fp);
 
 // Function declaration: Slaves
-void master(int S, int **links_status, struct train_type trains[], int num_trains, int **link_transit_time);
+void master(int links_status[], struct train_type trains[], int num_trains, struct link_graph *graph);
 void slave(int num_trains, int num_stations, char *G[], char *Y[], char *B[);
 
 // Functions: Updating network
-void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, char *line_stations_name_list[], char *all_stations_list[], int num_stations, int num_network_train_stations, int train_number, int *introduced_train_left, int *introduced_train_right) {
+void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, struct route_table *route, int train_number, int *introduced_train_left, int *introduced_train_right, int time_tick) {
     int starting_station = -1;
     if (*introduced_train_right == NOT_INTRODUCED) {
         starting_station = 0;
     } else if (*introduced_train_left == NOT_INTRODUCED) {
-        starting_station = num_stations - 1;
+        starting_station = route->num_stations - 1;
     }
     // Introducing a train into the network.
     if (starting_station != -1) {
@@ -109,8 +110,8 @@ void introduce_train_into_network(struct train_type *train, double all_stations_
         // If no trains are loading. We will start loading the introduced train immediately.
         if (line_stations[train->direction][starting_station] == READY_TO_LOAD) {
             line_stations[train->direction][starting_station] = train_number;                // The train number is the global train index. 
-            int global_station_index = get_all_station_index(num_network_train_stations, train->station, line_stations_name_list, all_stations_list);
-            train->loading_time = calculate_loadtime(all_stations_popularity_list[global_station_index]) - 1; 
+            int global_station_index = route->station[train->station];
+            train->loading_time = calculate_loadtime(all_stations_popularity_list[global_station_index], RNG_DEFAULT_SEED, train_number, time_tick) - 1; 
         }
     }
 }
@@ -165,19 +166,6 @@ void get_longest_shortest_average_waiting_time(int num_stations, int **station_w
 }
 
 // Functions: Helper functions
-int calculate_loadtime(double popularity) {
-    double random_number;
-    random_number = (rand() % 10) + 1;
-    return ceil(random_number * popularity);
-}
-int get_all_station_index(int num_stations, int line_station_index, char *line_stations[], char *all_stations_list[]) {
-    for (int i = 0; i < num_stations; i++) {   
-        if (strcmp(line_stations[line_station_index], all_stations_list[i]) == 0) {
-            return i;
-        }
-    }
-    return -1; // Error return code - this is to fix the compile error that no return type is specified
-}
 int get_next_station(int prev_station, int direction, int num_stations) {
     if (direction == RIGHT)
     {
@@ -196,56 +184,58 @@ int get_next_station(int prev_station, int direction, int num_stations) {
     return prev_station - 1;
 }
 
-void print_output(int iteration, struct train_type trains[], int num_trains, char *G[], char *Y[], char *B[], int num_green_trains, int num_yellow_trains, int num_blue_trains, char *all_stations_list[], int num_all_stations, int num_green_stations, int num_yellow_stations, int num_blue_stations, FILE* fp) {
+void print_output(int iteration, struct train_type trains[], int num_trains, struct route_table routes[], int num_green_trains, int num_yellow_trains, FILE* fp) {
     int i;
     int train_index;
     int current_station_index;
     int prev_station_index;
+    struct route_table *route;
+
     fprintf(fp, "%d:", iteration);
     // Print satus of all green trains first
+    route = &routes[GREEN];
     for (i = 0; i < num_green_trains; i++) {
         if (trains[i].status == NOT_IN_NETWORK) {
             continue;
         }
         else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, G, all_stations_list);
+            current_station_index = route->station[trains[i].station];
             fprintf(fp, " g%d-s%d,", i, current_station_index);
         } 
         else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, G, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_green_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, G, all_stations_list);
+            prev_station_index = route->station[trains[i].station];
+            current_station_index = route->next_global_station[trains[i].direction][trains[i].station];
             fprintf(fp, " g%d-s%d->s%d,", i, prev_station_index, current_station_index);
         }
     }
     // Yellow
+    route = &routes[YELLOW];
     for (i = num_green_trains; i < num_green_trains + num_yellow_trains; i++) {
         train_index = i - num_green_trains;
         if (trains[i].status == NOT_IN_NETWORK) {
             continue;
         }
         else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, Y, all_stations_list);
+            current_station_index = route->station[trains[i].station];
             fprintf(fp, " y%d-s%d,", train_index, current_station_index);
         } else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, Y, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_yellow_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, Y, all_stations_list);
+            prev_station_index = route->station[trains[i].station];
+            current_station_index = route->next_global_station[trains[i].direction][trains[i].station];
             fprintf(fp, " y%d-s%d->s%d,", train_index, prev_station_index, current_station_index);
         }
     }
+    route = &routes[BLUE];
     for (i = num_green_trains + num_yellow_trains; i < num_trains; i++) {
         train_index = i - num_green_trains - num_yellow_trains;
         if (trains[i].status == NOT_IN_NETWORK) {
             continue;
         }
         else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, B, all_stations_list);
+            current_station_index = route->station[trains[i].station];
             fprintf(fp, " b%d-s%d,", train_index, current_station_index);
         } else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, B, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_blue_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, B, all_stations_list);
+            prev_station_index = route->station[trains[i].station];
+            current_station_index = route->next_global_station[trains[i].direction][trains[i].station];
             fprintf(fp, " b%d-s%d->s%d,", train_index, prev_station_index, current_station_index);
         }
     }
@@ -254,32 +244,25 @@ void print_output(int iteration, struct train_type trains[], int num_trains, cha
 
 // Functions: Master Slaves
 // This function distributes respective link statuses to the slave thread and 
-void master(int S, int **links_status, struct train_type trains[], int num_trains, int **link_transit_time) {
+void master(int links_status[], struct train_type trains[], int num_trains, struct link_graph *graph) {
     int num_slaves = 0;
     int slave_id = 0;
-    int row_id;
-    int col_id;
-
-    // Send link statuses to the slaves
-    for (row_id = 0; row_id < S; row_id++) {
-        for (col_id = 0; col_id < S; col_id++) {
-            // A link exists between station: row_id and station: col_id
-            if (link_transit_time[row_id][col_id] != 0) {
-                // Send to slave thread an array containing information about the link. 
-                // [0] row_id, aka starting station
-                // [1] col_id, aka destination station
-                // [2] link status
-                // [3] link transit time
-                int link_information[4] = {row_id, col_id, links_status[row_id][col_id], link_transit_time[row_id][col_id]};
-                MPI_Send(link_information, 4, MPI_INTEGER, slave_id, row_id, MPI_COMM_WORLD);
-                slave_id++;
-            }
-        }
+    int link;
+
+    // Send link statuses to the slaves. The id of the link is the id of the slave.
+    for (link = 0; link < graph->num_links; link++) {
+        // Send to slave thread an array containing information about the link. 
+        // [0] row_id, aka starting station
+        // [1] col_id, aka destination station
+        // [2] link status
+        // [3] link transit time
+        int link_information[4] = {graph->from[link], graph->to[link], links_status[link], graph->transit_time[link]};
+        MPI_Send(link_information, 4, MPI_INTEGER, link, graph->from[link], MPI_COMM_WORLD);
     }
 
     // Send over the list of trains to the slaves
     printf("+++ MASTER: Now sending all the trains to the slaves.");
-    num_slaves = slave_id;
+    num_slaves = graph->num_links;
     int i;
     int j;
     slave_id = 0;
@@ -318,8 +301,6 @@ void slave(int num_trains) {
     int link_status = link_information_buffer[LINK_STATUS_INDEX];
     int link_transit_time = link_information_buffer[LINK_TRANSIT_TIME_INDEX];
 
-// int get_all_station_index(int num_stations, int line_station_index, char *line_stations[], char *all_stations_list[]) {
-// }
 // int get_next_station(int prev_station, int direction, int num_stations) {
 // }
     if (link_status == LINK_IS_USED) {
@@ -366,192 +347,35 @@ int main(int argc, char *argv[]) {
     int time_tick;
 
     //---------------------------- PARSING INPUT FROM THE INPUT FILE. -------------------------------//
-    char c[1000];
-    FILE *fptr;
-    if ((fptr = fopen("input.txt", "r")) == NULL)
-    {
-        printf("Error! opening file");
-        // Program exits if file pointer returns NULL.
-        exit(1);         
-    }
-    fgets(c, 1000, fptr);
-    int S = atoi(c);
-   
-    // Creating all stations list.
-    fgets(c, 1000, fptr);
-    char *all_stations_list[S];
-    const char delimiter[2] = ",";
-    char *station;             // pointer to the first character of station token.
-    station = strtok(c, delimiter);
-    for (i = 0 ; i < S; i++) {
-        all_stations_list[i] = station;
-        station = strtok(NULL, delimiter);
-    }
-    // REALLOCATE THE VALUES OF ALL STATIONS LISt.
-    for (i = 0 ; i < S; i++ ){
-        char *station = all_stations_list[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        all_stations_list[i] = station_value;  
-    }
-
-    // S x S matrix denoting the link transit time.
-    int *link_transit_time[S];
-    slaves = 0; // To initialize what the Master ID should be.
-    for (i = 0 ; i < S; i++) {
-        link_transit_time[i] = (int*)malloc(S * sizeof(int));
-    }
-    const char space_delimiter[2] = " ";
-    char *value;
-    int int_value;
-    // fgets S number of times.
-    for (i = 0 ; i < S; i++) {
-        fgets(c, 1000, fptr);
-        value = strtok(c, space_delimiter);
-        int_value = atoi(value);
-        for (j = 0 ; j < S; j++) {
-            int_value = atoi(value);
-            if (int_value != 0) {
-                slaves++;
-            }
-            link_transit_time[i][j] = int_value;
-            value = strtok(NULL, space_delimiter);
-        }
-    }
-   
-    // POPULARITY LIST.
-    double *all_stations_popularity_list = malloc(S * sizeof(double));
-    double double_value;
-    fgets(c, 1000, fptr);
-    value = strtok(c, space_delimiter);
-    sscanf(value, "%lf", &double_value);
-    for (i = 0 ; i < S; i++) {
-        sscanf(value, "%lf", &double_value);
-        all_stations_popularity_list[i] = double_value;
-        value = strtok(NULL, space_delimiter);
-    }
-    
-    
-    // GREEN TRAIN STATION LIST.
-    char *temp_G[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    i = 0;
-    int num_green_stations = 0;
-    while (station != NULL){
-        temp_G[num_green_stations] = station;
-        num_green_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *G[num_green_stations];
-    for (i = 0 ; i < num_green_stations; i++) {
-        G[i] = temp_G[i];
-    }
-    for (i = 0 ; i < num_green_stations; i++ ){
-        char *station = G[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        G[i] = station_value;  
-    
-    }
-
-    // YELLOW TRAIN STATION LIST
-    char *temp_Y[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    int num_yellow_stations = 0;
-    while (station != NULL){
-        temp_Y[num_yellow_stations] = station;
-        num_yellow_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *Y[num_yellow_stations];
-    for (i = 0 ; i < num_yellow_stations; i++) {
-        Y[i] = temp_Y[i];
-    }
-    for (i = 0 ; i < num_yellow_stations; i++ ){
-        char *station = Y[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        Y[i] = station_value;  
-    }
-
-    // BLUE TRAIN STATION LIST
-    char *temp_B[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    int num_blue_stations = 0;
-    while (station != NULL){
-        temp_B[num_blue_stations] = station;
-        num_blue_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *B[num_blue_stations];
-    for (i = 0 ; i < num_blue_stations; i++) {
-        B[i] = temp_B[i];
-    }
-    for (i = 0 ; i < num_blue_stations; i++ ){
-        char *station = B[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        B[i] = station_value;  
-    }
-
-    // Get count of number of trains and close file pointer
-    fgets(c, 1000, fptr);
-    int N = atoi(c); 
-    fgets(c, 1000, fptr);
-
-    value = strtok(c, delimiter);
-    int g = atoi(value);
-    value = strtok(NULL, delimiter);
-    int y = atoi(value);
-    value = strtok(NULL, delimiter);
-    int b = atoi(value);
-    fclose(fptr);
+    // input.txt is mapped and read in one pass, or used as it is if it is a snapshot (train_input.c). The lines come
+    // with the global index of their stations and their route tables.
+    struct network_input input;
+    if (load_network_input(&input, "input.txt") != 0) {
+        exit(1);
+    }
+    int S = input.num_stations;
+    double *all_stations_popularity_list = input.popularity;
+    struct link_graph graph = input.graph;
+    slaves = graph.num_links; // To initialize what the Master ID should be.
+    int num_green_stations = input.num_line_stations[INPUT_GREEN];
+    int num_yellow_stations = input.num_line_stations[INPUT_YELLOW];
+    int num_blue_stations = input.num_line_stations[INPUT_BLUE];
+    int N = input.num_ticks;
+    int g = input.num_line_trains[INPUT_GREEN];
+    int y = input.num_line_trains[INPUT_YELLOW];
+    int b = input.num_line_trains[INPUT_BLUE];
     
     //---------------------------- PARSING INPUT FROM THE INPUT FILE. -------------------------------//
-    // INITIALISATION of link statuses.
-    int *links_status[S];
-    for (i = 0; i < S; i++) {
-        links_status[i] = (int*)malloc(S * sizeof(int));
-    }
-    for (i = 0; i < S; i++) {
-        for (j = 0; j < S; j++) {
-            links_status[i][j] = LINK_IS_EMPTY;
-        }
+    // INITIALISATION of the route tables of each line. Indexed by the line of the train.
+    struct route_table routes[3];
+    routes[GREEN] = input.routes[INPUT_GREEN];
+    routes[YELLOW] = input.routes[INPUT_YELLOW];
+    routes[BLUE] = input.routes[INPUT_BLUE];
+
+    // INITIALISATION of link statuses, indexed by link id.
+    int *links_status = (int*)malloc(graph.num_links * sizeof(int));
+    for (i = 0; i < graph.num_links; i++) {
+        links_status[i] = LINK_IS_EMPTY;
     }
 
     // INITIALISATION of the status of all the trains.
@@ -618,17 +442,6 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    // INITALISATION of 2D array to keep track of which link to free up. If an entry is 1 it means that a train just finished transitting in the link. 0 otherwise.
-    int *links_status_update[S];
-    for (i = 0; i < S; i ++) {
-        links_status_update[i] = (int*)malloc(S * sizeof(int));
-    }
-    for (i = 0; i < S; i ++) {
-        for (j = 0; j < S; j++) {
-            links_status_update[i][j] = LINK_DEFAULT_STATUS;
-        }
-    }
-
     // INITIALISATION of logs
     FILE* fp = fopen("log.txt", "w");
 
@@ -649,31 +462,23 @@ int main(int argc, char *argv[]) {
         for (i = 0 ; i < num_all_trains; i++) {
             // Initialising variables for each train's line.
             int **line_stations;
-            char **line_stations_name_list;
-            int num_stations;
             int *introduced_train_left;
             int *introduced_train_right;
             if (trains[i].line == GREEN) {
                 introduced_train_left = &introduced_train[LEFT][GREEN];
                 introduced_train_right = &introduced_train[RIGHT][GREEN];
                 line_stations = green_stations;
-                line_stations_name_list = G;
-                num_stations = num_green_stations;
             } else if (trains[i].line == BLUE) {
                 introduced_train_left = &introduced_train[LEFT][BLUE];
                 introduced_train_right = &introduced_train[RIGHT][BLUE];
                 line_stations = blue_stations;
-                line_stations_name_list = B;
-                num_stations = num_blue_stations;
             } else {
                 introduced_train_left = &introduced_train[LEFT][YELLOW];
                 introduced_train_right = &introduced_train[RIGHT][YELLOW];
                 line_stations = yellow_stations;
-                line_stations_name_list = Y;
-                num_stations = num_yellow_stations;
             }
             if (trains[i].status == NOT_IN_NETWORK) {
-                introduce_train_into_network(&trains[i], all_stations_popularity_list, line_stations, line_stations_name_list, all_stations_list, num_stations, S, i, introduced_train_left, introduced_train_right);
+                introduce_train_into_network(&trains[i], all_stations_popularity_list, line_stations, &routes[trains[i].line], i, introduced_train_left, introduced_train_right, time_tick);
             }
         }
 
@@ -690,7 +495,7 @@ int main(int argc, char *argv[]) {
         // Send the data of each link_status to a thread
         if (myid == MASTER_ID) {
 		    fprintf(stderr, " +++ Process %d is master\n", myid);
-		    master(S, links_status, trains, num_all_trains, link_transit_time);
+		    master(links_status, trains, num_all_trains, &graph);
 	    } else {
 		    fprintf(stderr, " --- Process %d is slave\n", myid);
 		    slave();
@@ -709,25 +514,21 @@ int main(int argc, char *argv[]) {
         for (i = 0 ; i < num_all_trains; i++) {
             if (trains[i].status == IN_STATION) {
                 int **line_stations;
-                int all_stations_index;
-                // note(lowjiansheng): The station index here is probably the local station index?
+                int all_stations_index = routes[trains[i].line].station[trains[i].station];
                 // NEED SOME WAY TO RANDOMIZE THIS. Else yellow and blue line trains might get starved.
                 if (trains[i].line == GREEN) {
                     line_stations = green_stations;
-                    all_stations_index = get_all_station_index(num_all_trains, trains[i].station, G, all_stations_list);
                 }
                 else if (trains[i].line == BLUE) {
                     line_stations = blue_stations;
-                    all_stations_index = get_all_station_index(num_all_trains, trains[i].station, B, all_stations_list);
                 }
                 else {
                     line_stations = yellow_stations;
-                    all_stations_index = get_all_station_index(num_all_trains, trains[i].station, Y, all_stations_list);
                 }
                 // Load the current train in the station.
                 if (station_status[all_stations_index] == READY_TO_LOAD){
                     station_status[all_stations_index] = LOADING;
-                    int load_time = calculate_loadtime(123);
+                    int load_time = calculate_loadtime(123, RNG_DEFAULT_SEED, i, time_tick);
                     trains[i].loading_time = load_time;
                     // note(lowjiansheng): do we need to use the green_stations / blue_stations / yellow_stations arrays?
                     line_stations[trains[i].direction][trains[i].station] = i;
@@ -763,7 +564,7 @@ int main(int argc, char *argv[]) {
             }
         }
         // Log current iteration information to an output file
-        print_output(time_tick, trains, num_all_trains, G, Y, B, g, y, b, all_stations_list, S, num_green_stations, num_yellow_stations, num_blue_stations, fp);
+        print_output(time_tick, trains, num_all_trains, routes, g, y, fp);
     }
     // Close clock for time
     clock_t difference = clock() - before;
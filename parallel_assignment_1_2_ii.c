@@ -3,7 +3,7 @@
  **/
 
 // ASSUMPTIONS:
-// 1. Number of processes = Number of links in the network. Else the program will not work.
+// 1. At least 2 processes. The links are split in blocks over the slaves, any number of slaves works.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +12,9 @@
 #include <mpi.h>
 #include <math.h>
 #include <limits.h>
+#include "train_network.h"
+#include "train_input.h"
+#include "train_rng.h"
 
 // Train Status
 #define IN_TRANSIT 1
@@ -26,10 +29,6 @@
 #define LINK_IS_EMPTY -1
 #define LINK_DEFAULT_STATUS -2
 
-// Direction
-#define LEFT 0      // FROM END OF ARRAY TO START 
-#define RIGHT 1     // FROM START OF ARRAY TO END
-
 // Station status
 #define READY_TO_LOAD -1
 #define UNVISITED -2
@@ -46,23 +45,20 @@
 
 // Parallel variables
 #define MASTER_ID slaves
-#define TRAIN_INFORMATION_TAG 1
-#define LINK_INFORMATION_TAG 2
 // (For links)
 #define MSG_LINK_ROW_ID 0
 #define MSG_LINK_COL_ID 1
 #define MSG_LINK_STATUS 2
 #define MSG_LINK_TRANSIT_TIME 3
-#define NUM_TRAINS 4
+#define MSG_LINK_TRAIN_TRANSIT_TIME 4
+#define MSG_LINK_SIZE 5
 
-// (receiving trains)
-#define MSG_TRAIN_CURRENT_STATION 0
-#define MSG_TRAIN_NEXT_STATION 1
-#define MSG_TRAIN_LINE 2
-#define MSG_TRAIN_LOADING_TIME 3
-#define MSG_TRAIN_TRANSIT_TIME 4
-#define MSG_TRAIN_STATUS 5
-#define MSG_TRAIN_GLOBAL 6
+// (returning results)
+#define MSG_RESULT_TRAIN 0
+#define MSG_RESULT_TRAIN_STATUS 1
+#define MSG_RESULT_TRAIN_TRANSIT_TIME 2
+#define MSG_RESULT_LINK_STATUS 3
+#define MSG_RESULT_SIZE 4
 
 struct train_type
 {
@@ -80,36 +76,42 @@ int myid;
 int num_blue_stations;
 int num_green_stations;
 int num_yellow_stations;
+uint64_t seed = RNG_DEFAULT_SEED;   // Seed of the loading times and of the random picks of trains. Set with --seed=N
+char *input_name = "input.txt";     // Network read by the master, input.txt or a snapshot. Set with --input=FILE
+MPI_Datatype link_row_type;         // MSG_LINK_SIZE ints, the row of a link sent to a slave
+MPI_Datatype result_row_type;       // MSG_RESULT_SIZE ints, the result of a link returned to the master
 
 #define MASTER_ID slaves
 
 // Function Declarations
-void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, char *line_stations_name_list[], char *all_stations_list[], int num_stations, int num_network_train_stations, int train_number, int *introduced_train_left, int *introduced_train_right);
-int calculate_loadtime(double popularity);
-int get_all_station_index(int num_stations, int line_station_index, char *line_stations[], char *all_stations_list[]);
+void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, struct route_table *route, int train_number, int *introduced_train_left, int *introduced_train_right);
 int get_next_station(int prev_station, int direction, int num_stations);
-void print_output(int iteration, struct train_type trains[], int num_trains, char *G[], char *Y[], char *B[], int num_green_trains, int num_yellow_trains, int num_blue_trains, char *all_stations_list[], int num_all_stations, int num_green_stations, int num_yellow_stations, int num_blue_stations, FILE* fp);
+void print_output(int iteration, struct train_type trains[], int num_trains, struct route_table routes[], int num_green_trains, int num_yellow_trains, FILE* fp);
 
 // Function declaration: Calculating waiting time
 double get_average_waiting_time(int num_green_stations, int **green_station_waiting_times, int N);
 void get_longest_shortest_average_waiting_time(int num_green_stations, int **green_station_waiting_times, int N, double *longest_average_waiting_time, double *shortest_average_waiting_time);
 
 // Function Declarations: MPI related
-int** slave_receive_data(int link_information_buffer[], int **trains_information_buffer);
-void slave_compute(int link_information_buffer[], int **trains_information_buffer, int train_to_return[]);
-void slave_send_result(int link_information_buffer[], int train_to_return[], int link_info_size, int train_to_return_size);
+int first_link_of_slave(int slave_id, int num_links);
+void slave_receive_links(int link_information_buffer[], int num_slave_links);
+void add_link_candidate(int **candidates, int *num_candidates, int *capacity, int train);
+void slave_receive_data(int *link_candidates[], int link_num_candidates[], int link_candidate_capacity[], int num_slave_links, int link_num_added[], int added_candidates[]);
+void slave_compute(int link_information_buffer[], int candidates[], int *num_candidates, int train_to_return[], int link, int time_tick);
+void slave_send_result(int link_information_buffer[], int result[], int num_slave_links);
 void slave();
-void master_distribute(int S, int **links_status, struct train_type trains[], int num_trains, int **link_transit_time, char *G[], char *Y[], char *B[], char *all_stations_list[]);
-void master_receive_result(int S, int station_status[], int **link_status, int **link_transit_time, struct train_type trains[], char *G[], char *Y[], char *B[], char *all_stations_list[], int **green_stations, int **yellow_stations, int **blue_stations);
+void master_distribute_links(int links_status[], struct link_graph *graph, int link_information_buffer[], int slave_num_links[], int slave_first_link[]);
+void master_distribute(struct train_type trains[], int num_trains, struct route_table routes[], int num_links, int candidate_link[], int ready_trains[], int link_num_added[], int first_added[], int added_candidates[], int slave_num_links[], int slave_first_link[], int slave_num_added[], int slave_first_added[]);
+void master_receive_result(int links_status[], struct train_type trains[], struct route_table routes[], int **green_stations, int **yellow_stations, int **blue_stations, int result_buffer[], int num_links, int slave_num_links[], int slave_first_link[]);
 void master();
 
 // Functions: Updating network
-void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, char *line_stations_name_list[], char *all_stations_list[], int num_stations, int num_network_train_stations, int train_number, int *introduced_train_left, int *introduced_train_right) {
+void introduce_train_into_network(struct train_type *train, double all_stations_popularity_list[], int **line_stations, struct route_table *route, int train_number, int *introduced_train_left, int *introduced_train_right) {
     int starting_station = -1;
     if (*introduced_train_right == NOT_INTRODUCED) {
         starting_station = 0;
     } else if (*introduced_train_left == NOT_INTRODUCED) {
-        starting_station = num_stations - 1;
+        starting_station = route->num_stations - 1;
     }
     // Introducing a train into the network.
     if (starting_station != -1) {
@@ -127,19 +129,6 @@ void introduce_train_into_network(struct train_type *train, double all_stations_
 }
 
 // Functions: Helper functions
-int calculate_loadtime(double popularity) {
-    double random_number;
-    random_number = (rand() % 10) + 1;
-    return ceil(random_number * popularity);
-}
-int get_all_station_index(int num_stations, int line_station_index, char *line_stations[], char *all_stations_list[]) {
-    for (int i = 0; i < num_stations; i++) {   
-        if (strcmp(line_stations[line_station_index], all_stations_list[i]) == 0) {
-            return i;
-        }
-    }
-    return -1; // Error return code - this is to fix the compile error that no return type is specified
-}
 int get_next_station(int prev_station, int direction, int num_stations) {
     if (direction == RIGHT) {
         // Reached the end of the station
@@ -155,59 +144,60 @@ int get_next_station(int prev_station, int direction, int num_stations) {
     }
     return prev_station - 1;
 }
-void print_output(int iteration, struct train_type trains[], int num_trains, char *G[], char *Y[], char *B[], int num_green_trains, int num_yellow_trains, int num_blue_trains, char *all_stations_list[], int num_all_stations, int num_green_stations, int num_yellow_stations, int num_blue_stations, FILE* fp) {
+void print_output(int iteration, struct train_type trains[], int num_trains, struct route_table routes[], int num_green_trains, int num_yellow_trains, FILE* fp) {
     int i;
     int train_index;
     int current_station_index;
     int prev_station_index;
+    struct route_table *route;
 
     fprintf(fp, "%d:", iteration);
     // Print satus of all green trains first
+    route = &routes[GREEN];
     for (i = 0; i < num_green_trains; i++) {
         if (trains[i].status == NOT_IN_NETWORK) {
             continue;
         }
         else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, G, all_stations_list);
+            current_station_index = route->station[trains[i].station];
             fprintf(fp, " g%d-s%d,", i, current_station_index);
         } 
         else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, G, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_green_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, G, all_stations_list);
+            prev_station_index = route->station[trains[i].station];
+            current_station_index = route->next_global_station[trains[i].direction][trains[i].station];
             fprintf(fp, " g%d-s%d->s%d,", i, prev_station_index, current_station_index);
         }
     }
 
     // Yellow
+    route = &routes[YELLOW];
     for (i = num_green_trains; i < num_green_trains + num_yellow_trains; i++) {
         train_index = i - num_green_trains;
         if (trains[i].status == NOT_IN_NETWORK) {
             continue;
         }
         else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, Y, all_stations_list);
+            current_station_index = route->station[trains[i].station];
             fprintf(fp, " y%d-s%d,", train_index, current_station_index);
         } else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, Y, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_yellow_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, Y, all_stations_list);
+            prev_station_index = route->station[trains[i].station];
+            current_station_index = route->next_global_station[trains[i].direction][trains[i].station];
             fprintf(fp, " y%d-s%d->s%d,", train_index, prev_station_index, current_station_index);
         }
     }
 
+    route = &routes[BLUE];
     for (i = num_green_trains + num_yellow_trains; i < num_trains; i++) {
         train_index = i - num_green_trains - num_yellow_trains;
         if (trains[i].status == NOT_IN_NETWORK) {
             continue;
         }
         else if (trains[i].status == IN_STATION) {
-            current_station_index = get_all_station_index(num_all_stations, trains[i].station, B, all_stations_list);
+            current_station_index = route->station[trains[i].station];
             fprintf(fp, " b%d-s%d,", train_index, current_station_index);
         } else if (trains[i].status == IN_TRANSIT) {
-            prev_station_index = get_all_station_index(num_all_stations, trains[i].station, B, all_stations_list);
-            current_station_index = get_next_station(trains[i].station, trains[i].direction, num_blue_stations);
-            current_station_index = get_all_station_index(num_all_stations, current_station_index, B, all_stations_list);
+            prev_station_index = route->station[trains[i].station];
+            current_station_index = route->next_global_station[trains[i].direction][trains[i].station];
             fprintf(fp, " b%d-s%d->s%d,", train_index, prev_station_index, current_station_index);
         }
     }
@@ -266,100 +256,102 @@ void get_longest_shortest_average_waiting_time(int num_stations, int **station_w
 /*************************************************************************************************************************************/
 
 /**
- * Function used by the slaves to receive data from the master
- * Each slave receives a MSG_LINK_STATUS_buffer which is an array containing value of the link
- * and a num_slaves x 6 matrix containing information of the train in the network
+ * Returns the first link of a slave. The links are split in blocks of consecutive links, one block per slave, of sizes
+ * that differ by at most one. The links of slave_id are first_link_of_slave(slave_id) to first_link_of_slave(slave_id + 1)
+ * excluded, so the master (slave_id = slaves) starts past the last link.
+ **/
+int first_link_of_slave(int slave_id, int num_links) {
+    return (int)((long long)slave_id * num_links / slaves);
+}
+
+/**
+ * Function used by the slaves to receive their links from the master, once before the first tick.
+ * Each slave receives the rows (MSG_LINK_SIZE ints each) of its own block of links from a scatter of the links. A link
+ * only changes when its slave puts a train on it or the train leaves it, so the slave keeps the rows from then on.
  **/
-// note(lowjiansheng): slave is receiving data well
-int** slave_receive_data(int link_information_buffer[], int **trains_information_buffer) {
+void slave_receive_links(int link_information_buffer[], int num_slave_links) {
     // [0] row_id, aka starting station
     // [1] col_id, aka destination station
     // [2] link status or train index
 	// [3] link transit time
-	// [4] num_trains;
-	int i;
-    int num_trains;
-	MPI_Status status;
-	// Receiving information regarding the status of the link.
-	MPI_Recv(link_information_buffer, 5, MPI_INT, MASTER_ID, 1, MPI_COMM_WORLD, &status);
-    num_trains = link_information_buffer[4];
-    trains_information_buffer = (int **)malloc(num_trains * sizeof(int*));
-    // TODO: The code is not getting past the below for loop.
-    // This is because of how trains_information_buffer is initialized.
-    // Look to the slave() function to try and debug.
-	for (i = 0 ; i < num_trains; i++){
-		trains_information_buffer[i] = (int*)malloc(7 * sizeof(int));
+	// [4] transit time left of the train on the link
+	MPI_Scatterv(NULL, NULL, NULL, link_row_type, link_information_buffer, num_slave_links, link_row_type, MASTER_ID, MPI_COMM_WORLD);
+}
+
+/**
+ * Adds train to the candidates of a link, kept in increasing order of their global index. The array grows as needed.
+ **/
+void add_link_candidate(int **candidates, int *num_candidates, int *capacity, int train) {
+    int i;
+    if (*num_candidates == *capacity) {
+        *capacity = *capacity == 0 ? 4 : 2 * *capacity;
+        *candidates = (int*)realloc(*candidates, *capacity * sizeof(int));
+    }
+    for (i = *num_candidates; i > 0 && (*candidates)[i - 1] > train; i--) {
+        (*candidates)[i] = (*candidates)[i - 1];
+    }
+    (*candidates)[i] = train;
+    (*num_candidates)++;
+}
+
+/**
+ * Function used by the slaves to receive data from the master
+ * Every slave keeps the candidates of its links, the trains that can board them (link_candidates[link],
+ * link_num_candidates[link] of them). A candidate only stops being one by boarding the link, which the slave does
+ * itself, so the master only sends the trains that became candidates in this tick: link_num_added gets their number for
+ * every link of the slave, and added_candidates their global indices, link after link.
+ **/
+void slave_receive_data(int *link_candidates[], int link_num_candidates[], int link_candidate_capacity[], int num_slave_links, int link_num_added[], int added_candidates[]) {
+    int num_added = 0;
+    int link;
+    int i;
+	MPI_Scatterv(NULL, NULL, NULL, MPI_INT, link_num_added, num_slave_links, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+	for (link = 0; link < num_slave_links; link++) {
+		num_added += link_num_added[link];
 	}
-	// Receiving a 7 * num_trains array containing information about the trains.
-	// [0] current all station of the train
-	// [1] next all station of the train
-	// [2] line of the train
-    // [3] loading time of the train
-	// [4] transit time of the train
-	// [5] status of the train
-	// [6] global index of the train
-	for (i = 0 ; i < num_trains; i++) {
-        MPI_Recv(trains_information_buffer[i], 7, MPI_INT, MASTER_ID, i, MPI_COMM_WORLD, &status);
+	if (num_added == 0) {
+		return;
+	}
+	MPI_Scatterv(NULL, NULL, NULL, MPI_INT, added_candidates, num_added, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+	num_added = 0;
+	for (link = 0; link < num_slave_links; link++) {
+		for (i = 0; i < link_num_added[link]; i++) {
+			add_link_candidate(&link_candidates[link], &link_num_candidates[link], &link_candidate_capacity[link], added_candidates[num_added++]);
+		}
 	}
-    return trains_information_buffer;
 }
 
 /** 
  * Function used by the slaves to compute the update to the network.
+ * Called for every link of the slave, link is the id of the link of link_information_buffer. candidates are the
+ * *num_candidates trains that can board the link, in increasing order of their global index. The train that boards the
+ * link is taken out of them.
  **/
-void slave_compute(int link_information_buffer[], int **trains_information_buffer, int train_to_return[]) {
-    train_to_return[0] = -1; // Set this to -1 to indicate that initially no train is entering the link
+void slave_compute(int link_information_buffer[], int candidates[], int *num_candidates, int train_to_return[], int link, int time_tick) {
+    train_to_return[MSG_RESULT_TRAIN] = -1; // Set this to -1 to indicate that initially no train is entering the link
 	if (link_information_buffer[2] == READY_TO_LOAD){
-        int num_trains = link_information_buffer[4];
-        int train_to_link_buffer[num_trains];
-        int buffer_index = 0;
-		int i;
-		for (i = 0 ; i < num_trains ; i++) {
-            if (trains_information_buffer[i][MSG_TRAIN_STATUS] == NOT_IN_NETWORK) {
-                continue;
-            }
-            //fprintf(stderr, "Slave %d going through i = %d\n",myid, i);
-            //fprintf(stderr, "%d\n", trains_information_buffer[i][0]);
-            /*
-            fprintf(stderr, "%d %d %d %d %d %d %d\n", trains_information_buffer[i][0],
-                                                        trains_information_buffer[i][1],
-                                                        trains_information_buffer[i][2],
-                                                        trains_information_buffer[i][3],
-                                                        trains_information_buffer[i][4],
-                                                        trains_information_buffer[i][5],
-                                                        trains_information_buffer[i][6]);
-			*/
-            // fprintf(stderr, "Slave %d got here at i = %d, Global index of train is: %d\n", myid, i, trains_information_buffer[i][MSG_TRAIN_GLOBAL]);
-            if (trains_information_buffer[i][MSG_TRAIN_CURRENT_STATION] == link_information_buffer[MSG_LINK_ROW_ID] && // Train current station is link's (from)
-				trains_information_buffer[i][MSG_TRAIN_NEXT_STATION] == link_information_buffer[MSG_LINK_COL_ID] &&  // Train next station is link's (to)
-				trains_information_buffer[i][MSG_TRAIN_STATUS] == IN_STATION && // Train in station
-				trains_information_buffer[i][MSG_TRAIN_LOADING_TIME] == FINISHED_LOADING) { // Train has finished loading in station and is ready to move up a link
-                // Put train index in buffer to be randomly popped
-                train_to_link_buffer[buffer_index] = i;
-                buffer_index ++;
-			}
-		}
         // No trains are waiting to board this link.
-        if (buffer_index == 0) {
+        if (*num_candidates == 0) {
             return;
         } else {
-            // Initialize random number seed
-            time_t t;
-            srand((unsigned) time(&t));
-            // Get random buffer index which holds all the train index that can board the link. This will give us a random train.
-            int random_buffer_index = rand() % buffer_index;
-            int random_train_index = train_to_link_buffer[random_buffer_index];
+            // Get random index in the candidates which holds all the train index that can board the link. This will give us a random train.
+            // Drawn for the link, so the pick does not depend on which slave holds the link.
+            int random_buffer_index = rng_draw(seed, RNG_STREAM_LINK_PICK, link, time_tick) % *num_candidates;
+            int random_train_index = candidates[random_buffer_index];
+            memmove(&candidates[random_buffer_index], &candidates[random_buffer_index + 1], (*num_candidates - random_buffer_index - 1) * sizeof(int));
+            (*num_candidates)--;
             // Update buffers with train & link information
-            train_to_return[0] = trains_information_buffer[random_train_index][MSG_TRAIN_GLOBAL];
-			train_to_return[1] = IN_TRANSIT;
-			train_to_return[2] = link_information_buffer[MSG_LINK_TRANSIT_TIME];
-			link_information_buffer[MSG_LINK_STATUS] = trains_information_buffer[random_train_index][MSG_TRAIN_GLOBAL];
+            train_to_return[MSG_RESULT_TRAIN] = random_train_index;
+			train_to_return[MSG_RESULT_TRAIN_STATUS] = IN_TRANSIT;
+			train_to_return[MSG_RESULT_TRAIN_TRANSIT_TIME] = link_information_buffer[MSG_LINK_TRANSIT_TIME];
+			link_information_buffer[MSG_LINK_STATUS] = random_train_index;
+			link_information_buffer[MSG_LINK_TRAIN_TRANSIT_TIME] = link_information_buffer[MSG_LINK_TRANSIT_TIME];
             // note(Marx) : Below is the debug statement to ensure a random train is chosen
-            // if (buffer_index > 1) {
+            // if (*num_candidates > 0) {
             //     fprintf(stderr, "\n\nAlert");
             //     int i = 0;
-            //     for (i = 0; i < buffer_index; i ++) {
-            //         fprintf(stderr, " | Train %d", train_to_link_buffer[i]);
+            //     for (i = 0; i < *num_candidates; i ++) {
+            //         fprintf(stderr, " | Train %d", candidates[i]);
             //     }
             //     fprintf(stderr, " | Are waiting to board the link [%d, %d]\n", link_information_buffer[MSG_LINK_ROW_ID], link_information_buffer[MSG_LINK_COL_ID]);
             //     fprintf(stderr, "We are randomly choosing, train index [%d] to board \n\n\n", random_train_index);
@@ -373,17 +365,19 @@ void slave_compute(int link_information_buffer[], int **trains_information_buffe
 	// There is a train in the link. We have to decrement the transit time of the train in the link.
 	else {
 		int index_of_train = link_information_buffer[MSG_LINK_STATUS]; // Remember that link_status stores the index of the train on it as well.
-		// Decrement the transit time of the train. 
-		// note(lowjiansheng): The result will be sent over as a size 3 array. It is a subset of the train struct.
+		// Decrement the transit time of the train. The link keeps it, the master does not send it.
+		// note(lowjiansheng): The result will be sent over as a record of MSG_RESULT_SIZE ints, a subset of the train struct
+		// and the status of the link (filled in by slave_send_result).
 		// [0]: global index of the train
 		// [1]: status of train
 		// [2]: transit time of train
-        int updated_transit_time = trains_information_buffer[index_of_train][MSG_TRAIN_TRANSIT_TIME] - 1;
-        int updated_train_status = trains_information_buffer[index_of_train][MSG_TRAIN_STATUS];
+		// [3]: status of the link
+        int updated_transit_time = --link_information_buffer[MSG_LINK_TRAIN_TRANSIT_TIME];
+        int updated_train_status = IN_TRANSIT;
         
-		train_to_return[0] = index_of_train;
-		train_to_return[1] = updated_train_status;
-		train_to_return[2] = updated_transit_time;
+		train_to_return[MSG_RESULT_TRAIN] = index_of_train;
+		train_to_return[MSG_RESULT_TRAIN_STATUS] = updated_train_status;
+		train_to_return[MSG_RESULT_TRAIN_TRANSIT_TIME] = updated_transit_time;
 		// The link will have to be vacant for the next train to come in.
 		if (updated_transit_time == 0) {
 			link_information_buffer[MSG_LINK_STATUS] = LINK_IS_EMPTY;
@@ -394,12 +388,16 @@ void slave_compute(int link_information_buffer[], int **trains_information_buffe
 
 /**
  * Function used by the slaves to send the updated train/link back to the master
+ * result has a record per link of the slave. The first MSG_RESULT_LINK_STATUS ints of a record are the train
+ * slave_compute returned, the status of the link is added after it and the records of all the links of the slave are
+ * gathered by the master in one message.
  **/
-void slave_send_result(int link_information_buffer[], int train_to_return[], int link_info_size, int train_to_return_size) {
-    // Send the Train info
-    MPI_Send(train_to_return, train_to_return_size, MPI_INT, MASTER_ID, TRAIN_INFORMATION_TAG, MPI_COMM_WORLD);
-    // Send the Link info
-    MPI_Send(link_information_buffer, link_info_size, MPI_INT, MASTER_ID, LINK_INFORMATION_TAG, MPI_COMM_WORLD);
+void slave_send_result(int link_information_buffer[], int result[], int num_slave_links) {
+    int link;
+    for (link = 0; link < num_slave_links; link++) {
+        result[link * MSG_RESULT_SIZE + MSG_RESULT_LINK_STATUS] = link_information_buffer[link * MSG_LINK_SIZE + MSG_LINK_STATUS];
+    }
+    MPI_Gatherv(result, num_slave_links, result_row_type, NULL, NULL, NULL, result_row_type, MASTER_ID, MPI_COMM_WORLD);
 }
 
 /**
@@ -407,22 +405,47 @@ void slave_send_result(int link_information_buffer[], int train_to_return[], int
  *
  **/
 void slave() {
-    int link_info_size = 5;
-    int train_info_size = 7;
-    int train_to_return_size = 3;
-
-	int link_information_buffer[link_info_size];
-	int **trains_information_buffer;
-    // Information to return to master
-	int train_to_return[train_to_return_size];
+    int network_size[2];
+    int num_trains;
+    int num_links;
+    int link;
+
+	int *link_information_buffer;
+	// Candidates of every link of the slave, kept from tick to tick
+	int **link_candidates;
+	int *link_num_candidates;
+	int *link_candidate_capacity;
+	// Candidates added in a tick
+	int *link_num_added;
+	int *added_candidates;
+    // Information to return to master, for every link the train slave_compute returns then the status of the link
+	int *result;
     int time_tick = 0;
+    // The master broadcasts the number of trains and of links once it has read the network. The buffers have the same
+    // size every tick, so they are allocated once.
+    MPI_Bcast(network_size, 2, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+    num_trains = network_size[0];
+    num_links = network_size[1];
+    int first_link = first_link_of_slave(myid, num_links);
+    int num_slave_links = first_link_of_slave(myid + 1, num_links) - first_link;
+    link_information_buffer = (int*)malloc((num_slave_links + 1) * MSG_LINK_SIZE * sizeof(int));
+    link_candidates = (int**)calloc(num_slave_links + 1, sizeof(int*));
+    link_num_candidates = (int*)calloc(num_slave_links + 1, sizeof(int));
+    link_candidate_capacity = (int*)calloc(num_slave_links + 1, sizeof(int));
+    // A train can board one link at most, so there are never more candidates than trains.
+    link_num_added = (int*)malloc((num_slave_links + 1) * sizeof(int));
+    added_candidates = (int*)malloc((num_trains + 1) * sizeof(int));
+    result = (int*)malloc((num_slave_links + 1) * MSG_RESULT_SIZE * sizeof(int));
+    slave_receive_links(link_information_buffer, num_slave_links);
 	// Receive data
     while (1){
-        trains_information_buffer = slave_receive_data(link_information_buffer, trains_information_buffer);
-        // Doing the computations
-        slave_compute(link_information_buffer, trains_information_buffer, train_to_return);
+        slave_receive_data(link_candidates, link_num_candidates, link_candidate_capacity, num_slave_links, link_num_added, added_candidates);
+        // Doing the computations, one link after the other
+        for (link = 0; link < num_slave_links; link++) {
+            slave_compute(&link_information_buffer[link * MSG_LINK_SIZE], link_candidates[link], &link_num_candidates[link], &result[link * MSG_RESULT_SIZE], first_link + link, time_tick);
+        }
         // Sending the results back
-        slave_send_result(link_information_buffer, train_to_return, link_info_size, train_to_return_size);
+        slave_send_result(link_information_buffer, result, num_slave_links);
         time_tick++;
     }
 
@@ -432,98 +455,111 @@ void slave() {
 /*************************************************************************************************************************************/
 
 /**
- * Function called by the master to distribute link_status
- * and the entire trains array to the child
+ * Function called by the master to distribute the links to the slaves, once before the first tick.
+ * The links are scattered, one row of MSG_LINK_SIZE ints per link, each slave gets the rows of its block of links
+ * (slave_num_links[slave_id] links from slave_first_link[slave_id]) and keeps them.
  **/
-void master_distribute(int S, int **links_status, struct train_type trains[], int num_trains, int **link_transit_time, char *G[], char *Y[], char *B[], char *all_stations_list[]) {
-    int i, j, k;
-	int row_id, col_id;
-	int slave_id = 0;
-	int num_links;
-	// Send link statuses to the slaves
-    // fprintf(stderr, "+++ Master: Now sending link informations to slaves.\n");
-    int temp_count = 0;
+void master_distribute_links(int links_status[], struct link_graph *graph, int link_information_buffer[], int slave_num_links[], int slave_first_link[]) {
+	int link;
+	int num_links = graph->num_links;
+	// Links statuses of the slaves, in the order of the links.
+    for (link = 0; link < num_links; link++) {
+        // [0] row_id, aka starting station
+        // [1] col_id, aka destination station
+        // [2] link status
+        // [3] link transit time
+        // [4] transit time left of the train on the link
+        int *link_information = &link_information_buffer[link * MSG_LINK_SIZE];
+        link_information[MSG_LINK_ROW_ID] = graph->from[link];
+        link_information[MSG_LINK_COL_ID] = graph->to[link];
+        link_information[MSG_LINK_STATUS] = links_status[link];
+        link_information[MSG_LINK_TRANSIT_TIME] = graph->transit_time[link];
+        link_information[MSG_LINK_TRAIN_TRANSIT_TIME] = 0;
+    }
+    MPI_Scatterv(link_information_buffer, slave_num_links, slave_first_link, link_row_type, MPI_IN_PLACE, 0, link_row_type, MASTER_ID, MPI_COMM_WORLD);
+}
 
-    for (row_id = 0; row_id < S; row_id++) {
-        for (col_id = 0; col_id < S; col_id++) {
-            // A link exists between station: row_id and station: col_id
-            if (link_transit_time[row_id][col_id] != 0) {
-                // Send to slave thread an array containing information about the link. 
-                // [0] row_id, aka starting station
-                // [1] col_id, aka destination station
-                // [2] link status
-                // [3] link transit time
-				// [4] num trains
-                int link_information[5] = {row_id, col_id, links_status[row_id][col_id], link_transit_time[row_id][col_id], num_trains};
-                MPI_Send(link_information, 5, MPI_INT, slave_id, 1, MPI_COMM_WORLD);
-                // fprintf(stderr, "+++ MASTER: Sent link information[%d, %d] to slave: %d\n", row_id, col_id, slave_id);
-                slave_id++;
-            }
-        }
+/**
+ * Function called by the master to distribute the trains to the slaves.
+ * A train is a candidate of a link when it is in a station, done loading, and the link leads to its next station. The
+ * slaves keep the candidates of their links and drop a train when it boards, so only the trains that became candidates
+ * since the last tick are sent. candidate_link[train] is the link the slaves have the train as a candidate of, or
+ * NO_LINK. The new candidates are put in added_candidates by link (link_num_added[link] of them from first_added[link]),
+ * in increasing order of their global index. The links of a slave are consecutive, so are their new candidates, and each
+ * slave is sent only the counts and the new candidates of its own links.
+ * Finding the new candidates looks at every train, as the master does in every other step of a tick, but nothing is
+ * sent for a train that has not changed.
+ **/
+void master_distribute(struct train_type trains[], int num_trains, struct route_table routes[], int num_links, int candidate_link[], int ready_trains[], int link_num_added[], int first_added[], int added_candidates[], int slave_num_links[], int slave_first_link[], int slave_num_added[], int slave_first_added[]) {
+    int i;
+	int link;
+	int slave_id;
+	int num_ready = 0;
+    for (link = 0; link < num_links; link++) {
+        link_num_added[link] = 0;
     }
-	// Send over the list of trains to the slaves
-    // fprintf(stderr, "+++ MASTER: Sending all %d trains to the slaves.\n", num_trains);
-    num_links = slave_id;
-    slave_id = 0;
-	// Send to slave thread an array containing information about the link. 
-	// [0] current station of the train
-	// [1] next station of the train
-	// [2] line of the train
-    // [3] loading time of the train
-	// [4] transit time of the train
-	// [5] status of the train
-	// [6] global index of the train
+	// Find the new candidates and count them for every link.
     for (i = 0 ; i < num_trains; i++) {
-        int current_station;
-		int next_station;
-		if (trains[i].status == NOT_IN_NETWORK) {
-            current_station = -1;
-            next_station = -1;
+        if (trains[i].status != IN_STATION || trains[i].loading_time != FINISHED_LOADING) {
+            // Boarded its link, or not ready yet.
+            candidate_link[i] = NO_LINK;
+            continue;
         }
-        else if (trains[i].line == GREEN){
-			current_station = get_all_station_index(S, trains[i].station, G,  all_stations_list);
-            next_station = get_all_station_index(S, get_next_station(trains[i].station, trains[i].direction, num_green_stations), G, all_stations_list);
-		}
-		else if (trains[i].line == BLUE) {
-			current_station = get_all_station_index(S, trains[i].station, B,  all_stations_list);
-			next_station = get_all_station_index(S, get_next_station(trains[i].station, trains[i].direction, num_blue_stations), B, all_stations_list);	
-		}
-		else {
-			current_station = get_all_station_index(S, trains[i].station, Y,  all_stations_list);
-			next_station = get_all_station_index(S, get_next_station(trains[i].station, trains[i].direction, num_yellow_stations), Y, all_stations_list);	
-		}
-        int train_status[7] = { current_station, next_station, trains[i].line, trains[i].loading_time, trains[i].transit_time, trains[i].status, i};
-        for (slave_id = 0; slave_id < num_links; slave_id++) {
-            MPI_Send(train_status, 7, MPI_INT, slave_id, i, MPI_COMM_WORLD);
+        if (candidate_link[i] != NO_LINK) {
+            continue;
+        }
+        link = routes[trains[i].line].link[trains[i].direction][trains[i].station];
+        if (link != NO_LINK) {
+            candidate_link[i] = link;
+            ready_trains[num_ready++] = i;
+            link_num_added[link]++;
         }
     }
+    first_added[0] = 0;
+    for (link = 0; link < num_links; link++) {
+        first_added[link + 1] = first_added[link] + link_num_added[link];
+        link_num_added[link] = 0;
+    }
+    // Put the new candidates in place, the counts are counted again on the way.
+    for (i = 0 ; i < num_ready; i++) {
+        link = candidate_link[ready_trains[i]];
+        added_candidates[first_added[link] + link_num_added[link]] = ready_trains[i];
+        link_num_added[link]++;
+    }
+    // New candidates of the block of links of every slave, the master has none.
+    for (slave_id = 0; slave_id <= slaves; slave_id++) {
+        slave_first_added[slave_id] = first_added[slave_first_link[slave_id]];
+        slave_num_added[slave_id] = first_added[slave_first_link[slave_id] + slave_num_links[slave_id]] - slave_first_added[slave_id];
+    }
+    MPI_Scatterv(link_num_added, slave_num_links, slave_first_link, MPI_INT, MPI_IN_PLACE, 0, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+    // The slaves know how many trains they get, and do not wait for them when there are none.
+    if (num_ready > 0) {
+        MPI_Scatterv(added_candidates, slave_num_added, slave_first_added, MPI_INT, MPI_IN_PLACE, 0, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+    }
 }
 
 /**
  * Receives the result array information from the slaves
+ * Every slave returns one record of MSG_RESULT_SIZE ints per link of its block (the train the link modified, if any,
+ * and the status of the link), gathered into result_buffer in the order of the links. The records are then applied in
+ * that order in a single pass.
  **/
-void master_receive_result(int S, int station_status[], int **link_status, int **link_transit_time, struct train_type trains[], char *G[], char *Y[], char *B[], char *all_stations_list[], int **green_stations, int **yellow_stations, int **blue_stations) {
-	MPI_Status status;
-	// Master waits for an array describing the train link status and an array of the train that has been modified.
+void master_receive_result(int links_status[], struct train_type trains[], struct route_table routes[], int **green_stations, int **yellow_stations, int **blue_stations, int result_buffer[], int num_links, int slave_num_links[], int slave_first_link[]) {
+	// Master waits for a record of the train that has been modified and of the link status from every link.
     // fprintf(stderr, "+++ MASTER : Now receiving results back from the slaves\n");
-	int i, j;
-	int slave_id = 0;
-	int link_information_buffer[5];
-	int train_information_buffer[7];
+	int link = 0;
 
-	// Wait for an array describing the only train that has been modified by the link. 
-	// note(lowjiansheng): The tag_id will be the slave_id as each slave will only return 1 train that has been modified.
-    for (slave_id = 0 ; slave_id < slaves; slave_id++) {
-        MPI_Recv(&train_information_buffer, 7, MPI_INT, slave_id, TRAIN_INFORMATION_TAG, MPI_COMM_WORLD, &status);
-		MPI_Recv(&link_information_buffer, 5, MPI_INT, slave_id, LINK_INFORMATION_TAG, MPI_COMM_WORLD, &status);
-        //---------------------------- NO UPDATE FROM THIS SLAVE -------------------------------//
-        if (train_information_buffer[0] < 0) {
+	MPI_Gatherv(MPI_IN_PLACE, 0, result_row_type, result_buffer, slave_num_links, slave_first_link, result_row_type, MASTER_ID, MPI_COMM_WORLD);
+    for (link = 0 ; link < num_links; link++) {
+        int *result = &result_buffer[link * MSG_RESULT_SIZE];
+        //---------------------------- NO UPDATE FROM THIS LINK -------------------------------//
+        if (result[MSG_RESULT_TRAIN] < 0) {
             continue;
         }
         //---------------------------- UPDATE TRAINS -------------------------------//
-        int train_index = train_information_buffer[0];
-        int train_status = train_information_buffer[1];
-        int train_transit_time = train_information_buffer[2];
+        int train_index = result[MSG_RESULT_TRAIN];
+        int train_status = result[MSG_RESULT_TRAIN_STATUS];
+        int train_transit_time = result[MSG_RESULT_TRAIN_TRANSIT_TIME];
 
         // Case 1: Train is on the link and still has transit time, just decrement transit time and move on to the next slave
         if (trains[train_index].status == IN_TRANSIT && train_transit_time > 0) {
@@ -549,7 +585,7 @@ void master_receive_result(int S, int station_status[], int **link_status, int *
                 line_stations = yellow_stations;
             }
 
-            next_station = get_next_station(prev_station, trains[train_index].direction, num_stations);
+            next_station = routes[trains[train_index].line].next_station[trains[train_index].direction][prev_station];
             // fprintf(stderr, "\nFrom local: %d ---> To Local: %d", prev_station, next_station);
             // Update the direction of the train (For trains reaching a terminal station)
             next_direction = trains[train_index].direction;
@@ -568,26 +604,11 @@ void master_receive_result(int S, int station_status[], int **link_status, int *
         } 
         // Case 3: Train just got onto the link
         else {
-            int current_station = trains[train_index].station;
-            int **line_stations;
-			char **line_stations_names;
-            if (trains[train_index].line == GREEN) {
-                line_stations = green_stations;
-				line_stations_names = G;
-            } else if (trains[train_index].line == BLUE) {
-                line_stations = blue_stations;
-				line_stations_names = B;
-            } else {
-                line_stations = yellow_stations;
-				line_stations_names = Y;
-            }
-            int current_all_station_index = get_all_station_index(S, current_station, line_stations_names, all_stations_list);
-            int current_direction = trains[train_index].direction;
             trains[train_index].status = train_status;
             trains[train_index].transit_time = train_transit_time;
         }
         //---------------------------- UPDATE LINKS -------------------------------//
-		link_status[link_information_buffer[MSG_LINK_ROW_ID]][link_information_buffer[MSG_LINK_COL_ID]] = link_information_buffer[MSG_LINK_STATUS];
+		links_status[link] = result[MSG_RESULT_LINK_STATUS];
     }
 }
 
@@ -600,199 +621,66 @@ void master() {
     int time_tick;
 
 	//---------------------------- PARSING INPUT FROM THE INPUT FILE. -------------------------------//
-    char c[1000];
-    FILE *fptr;
-    if ((fptr = fopen("input.txt", "r")) == NULL)
-    {
-        printf("Error! opening file");
-        // Program exits if file pointer returns NULL.
-        exit(1);         
-    }
-    fgets(c, 1000, fptr);
-    int S = atoi(c);
-   
-    // Creating all stations list.
-    fgets(c, 1000, fptr);
-    char *all_stations_list[S];
-    const char delimiter[2] = ",";
-    char *station;             // pointer to the first character of station token.
-    station = strtok(c, delimiter);
-    for (i = 0 ; i < S; i++) {
-        all_stations_list[i] = station;
-        station = strtok(NULL, delimiter);
-    }
-    // REALLOCATE THE VALUES OF ALL STATIONS LISt.
-    for (i = 0 ; i < S; i++ ){
-        char *station = all_stations_list[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        all_stations_list[i] = station_value;  
-    }
-
-    // S x S matrix denoting the link transit time.
-    int *link_transit_time[S];
-    slaves = 0; // To initialize what the Master ID should be.
-    for (i = 0 ; i < S; i++) {
-        link_transit_time[i] = (int*)malloc(S * sizeof(int));
-    }
-    const char space_delimiter[2] = " ";
-    char *value;
-    int int_value;
-    // fgets S number of times.
-    for (i = 0 ; i < S; i++) {
-        fgets(c, 1000, fptr);
-        value = strtok(c, space_delimiter);
-        int_value = atoi(value);
-        for (j = 0 ; j < S; j++) {
-            int_value = atoi(value);
-            if (int_value != 0) {
-                slaves++;
-            }
-            link_transit_time[i][j] = int_value;
-            value = strtok(NULL, space_delimiter);
-        }
-    }
-   
-    // POPULARITY LIST.
-    double *all_stations_popularity_list = malloc(S * sizeof(double));
-    double double_value;
-    fgets(c, 1000, fptr);
-    value = strtok(c, space_delimiter);
-    sscanf(value, "%lf", &double_value);
-    for (i = 0 ; i < S; i++) {
-        sscanf(value, "%lf", &double_value);
-        all_stations_popularity_list[i] = double_value;
-        value = strtok(NULL, space_delimiter);
-    }
-    
-    
-    // GREEN TRAIN STATION LIST.
-    char *temp_G[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    i = 0;
-    num_green_stations = 0;
-    while (station != NULL){
-        temp_G[num_green_stations] = station;
-        num_green_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *G[num_green_stations];
-    for (i = 0 ; i < num_green_stations; i++) {
-        G[i] = temp_G[i];
-    }
-    for (i = 0 ; i < num_green_stations; i++ ){
-        char *station = G[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        G[i] = station_value;  
-    
-    }
-
-    // YELLOW TRAIN STATION LIST
-    char *temp_Y[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    num_yellow_stations = 0;
-    while (station != NULL){
-        temp_Y[num_yellow_stations] = station;
-        num_yellow_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *Y[num_yellow_stations];
-    for (i = 0 ; i < num_yellow_stations; i++) {
-        Y[i] = temp_Y[i];
-    }
-    for (i = 0 ; i < num_yellow_stations; i++ ){
-        char *station = Y[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        Y[i] = station_value;  
-    }
-
-    // BLUE TRAIN STATION LIST
-    char *temp_B[S];
-    fgets(c, 1000, fptr);
-    station = strtok(c, delimiter);
-    num_blue_stations = 0;
-    while (station != NULL){
-        temp_B[num_blue_stations] = station;
-        num_blue_stations++;
-        station = strtok(NULL, delimiter);
-    }
-    char *B[num_blue_stations];
-    for (i = 0 ; i < num_blue_stations; i++) {
-        B[i] = temp_B[i];
-    }
-    for (i = 0 ; i < num_blue_stations; i++ ){
-        char *station = B[i];
-        int index = 0;
-        char *station_value = malloc(100*sizeof(char));
-        while (station[index] != '\0') {
-            if (station[index] == '\n'){
-                break;
-            }
-            station_value[index] = station[index];
-            index++;
-        }
-        station_value[index] = '\0';
-        B[i] = station_value;  
-    }
-
-    // Get count of number of trains and close file pointer
-    fgets(c, 1000, fptr);
-    int N = atoi(c); 
-    fgets(c, 1000, fptr);
-
-    value = strtok(c, delimiter);
-    int g = atoi(value);
-    value = strtok(NULL, delimiter);
-    int y = atoi(value);
-    value = strtok(NULL, delimiter);
-    int b = atoi(value);
-    fclose(fptr);
+    // The network is mapped and read in one pass, or mapped and used as it is if it is a snapshot (train_input.c). The
+    // lines come with the global index of their stations and their route tables.
+    struct network_input input;
+    if (load_network_input(&input, input_name) != 0) {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int S = input.num_stations;
+    double *all_stations_popularity_list = input.popularity;
+    struct link_graph graph = input.graph;
+    num_green_stations = input.num_line_stations[INPUT_GREEN];
+    num_yellow_stations = input.num_line_stations[INPUT_YELLOW];
+    num_blue_stations = input.num_line_stations[INPUT_BLUE];
+    int N = input.num_ticks;
+    int g = input.num_line_trains[INPUT_GREEN];
+    int y = input.num_line_trains[INPUT_YELLOW];
+    int b = input.num_line_trains[INPUT_BLUE];
     num_trains = g + y + b;
     //---------------------------- PARSING INPUT FROM THE INPUT FILE. -------------------------------//
+    // INITIALISATION of the route tables of each line. Indexed by the line of the train.
+    struct route_table routes[3];
+    routes[GREEN] = input.routes[INPUT_GREEN];
+    routes[YELLOW] = input.routes[INPUT_YELLOW];
+    routes[BLUE] = input.routes[INPUT_BLUE];
     fprintf(stderr, " ~~~~~~~~~~~~~~~~~~~~~~~~ Master done parsing input file. With num trains: %d\n", num_trains);
+    // The slaves size their buffers and find their block of links with the number of trains and of links.
+    int network_size[2] = {num_trains, graph.num_links};
+    MPI_Bcast(network_size, 2, MPI_INT, MASTER_ID, MPI_COMM_WORLD);
+    // Block of links of every slave, the master (slave_id = slaves) has none.
+    int slave_num_links[slaves + 1];
+    int slave_first_link[slaves + 1];
+    for (i = 0; i <= slaves; i++) {
+        slave_first_link[i] = first_link_of_slave(i, graph.num_links);
+        slave_num_links[i] = i == slaves ? 0 : first_link_of_slave(i + 1, graph.num_links) - slave_first_link[i];
+    }
+    int *link_information_buffer = (int*)malloc(graph.num_links * MSG_LINK_SIZE * sizeof(int));
+    // Trains the slaves have as candidates and those added in a tick (see master_distribute).
+    int *candidate_link = (int*)malloc((num_trains + 1) * sizeof(int));
+    int *ready_trains = (int*)malloc((num_trains + 1) * sizeof(int));
+    int *link_num_added = (int*)malloc((graph.num_links + 1) * sizeof(int));
+    int *first_added = (int*)malloc((graph.num_links + 1) * sizeof(int));
+    int *added_candidates = (int*)malloc((num_trains + 1) * sizeof(int));
+    int slave_num_added[slaves + 1];
+    int slave_first_added[slaves + 1];
+    for (i = 0; i < num_trains; i++) {
+        candidate_link[i] = NO_LINK;
+    }
+    int *result_buffer = (int*)malloc(graph.num_links * MSG_RESULT_SIZE * sizeof(int));
     //---------------------------- INITIALISATION OF STATUS TRACKING ARRAYS -------------------------------//
 	
 	// INITIALISATION of link statuses.
     // LINK STATUS:
     // STORES GLOBAL INDEX OF THE TRAIN IF THE TRAIN IS IN THE LINK.
     // ELSE LINK_IS_EMPTY.
-    int *links_status[S];
-    for (i = 0; i < S; i++) {
-        links_status[i] = (int*)malloc(S * sizeof(int));
-    }
-    for (i = 0; i < S; i++) {
-        for (j = 0; j < S; j++) {
-            links_status[i][j] = LINK_IS_EMPTY;
-        }
+    // Indexed by link id.
+    int *links_status = (int*)malloc(graph.num_links * sizeof(int));
+    for (i = 0; i < graph.num_links; i++) {
+        links_status[i] = LINK_IS_EMPTY;
     }
+    // The slaves keep their links from now on.
+    master_distribute_links(links_status, &graph, link_information_buffer, slave_num_links, slave_first_link);
 
     // INITIALISATION of the status of all the trains.
     int num_all_trains = g + y + b;
@@ -858,17 +746,6 @@ void master() {
         }
     }
 
-    // INITALISATION of 2D array to keep track of which link to free up. If an entry is 1 it means that a train just finished transitting in the link. 0 otherwise.
-    int *links_status_update[S];
-    for (i = 0; i < S; i ++) {
-        links_status_update[i] = (int*)malloc(S * sizeof(int));
-    }
-    for (i = 0; i < S; i ++) {
-        for (j = 0; j < S; j++) {
-            links_status_update[i][j] = LINK_DEFAULT_STATUS;
-        }
-    }
-
     // INITIALISATION of logs
     FILE* fp = fopen("log.txt", "w");
 
@@ -889,44 +766,28 @@ void master() {
 		for (i = 0 ; i < num_all_trains; i++) {
             // Initialising variables for each train's line.
             int **line_stations;
-            char **line_stations_name_list;
-            int num_stations;
-            int *introduced_train_left;
-            int *introduced_train_right;
+            int *introduced_train_left = &introduced_train[LEFT][trains[i].line];
+            int *introduced_train_right = &introduced_train[RIGHT][trains[i].line];
             if (trains[i].line == GREEN) {
-                introduced_train_left = &introduced_train[LEFT][GREEN];
-                introduced_train_right = &introduced_train[RIGHT][GREEN];
                 line_stations = green_stations;
-                line_stations_name_list = G;
-                num_stations = num_green_stations;
             } else if (trains[i].line == BLUE) {
-                introduced_train_left = &introduced_train[LEFT][BLUE];
-                introduced_train_right = &introduced_train[RIGHT][BLUE];
                 line_stations = blue_stations;
-                line_stations_name_list = B;
-                num_stations = num_blue_stations;
             } else {
-                introduced_train_left = &introduced_train[LEFT][YELLOW];
-                introduced_train_right = &introduced_train[RIGHT][YELLOW];
                 line_stations = yellow_stations;
-                line_stations_name_list = Y;
-                num_stations = num_yellow_stations;
             }
             if (trains[i].status == NOT_IN_NETWORK) {
-                introduce_train_into_network(&trains[i], all_stations_popularity_list, line_stations, line_stations_name_list, all_stations_list, num_stations, S, i, introduced_train_left, introduced_train_right);
+                introduce_train_into_network(&trains[i], all_stations_popularity_list, line_stations, &routes[trains[i].line], i, introduced_train_left, introduced_train_right);
             }
         }
 		
 		// STEP 2: ---------------------------- PARALLEL (Update Links) ----------------------------
         // fprintf(stderr, " ~~~~~~~~~~~~~~~~~~~~~~~~ Time tick: %d | Master distributing parallel code\n", time_tick);
-		master_distribute(S, links_status, trains, num_all_trains, link_transit_time, G, Y, B, all_stations_list);
-		master_receive_result(S, station_status, links_status, link_transit_time, trains, G, Y, B, all_stations_list, green_stations, yellow_stations, blue_stations);
+		master_distribute(trains, num_all_trains, routes, graph.num_links, candidate_link, ready_trains, link_num_added, first_added, added_candidates, slave_num_links, slave_first_link, slave_num_added, slave_first_added);
+		master_receive_result(links_status, trains, routes, green_stations, yellow_stations, blue_stations, result_buffer, graph.num_links, slave_num_links, slave_first_link);
         // STEP 3: ---------------------------- MASTER (Load trains into empty stations) ----------------------------
         for (i = 0 ; i < S; i++) {
             int station_trains_buffer[num_all_trains];
             int buffer_index = 0;
-            time_t t;
-            srand((unsigned) time(&t));
             if (station_status[i] == LOADING) {
                 // note(Marx): Should expect that station 7 is here in first few iterations. but it is not
                 // fprintf(stderr, "\nIteration %d. Station %d is loading\n", time_tick, i);
@@ -936,16 +797,7 @@ void master() {
                     if (trains[j].status == NOT_IN_NETWORK) {
                         continue;
                     }
-                    int all_stations_index;
-                    if (trains[j].line == GREEN) {
-                        all_stations_index = get_all_station_index(S, trains[j].station, G, all_stations_list);
-                    }   
-                    else if (trains[j].line == BLUE) {
-                        all_stations_index = get_all_station_index(S, trains[j].station, B, all_stations_list);
-                    }
-                    else {
-                        all_stations_index = get_all_station_index(S, trains[j].station, Y, all_stations_list);
-                    }
+                    int all_stations_index = routes[trains[j].line].station[trains[j].station];
                     // fprintf(stderr, "\n[Step 3] Debug here: Train status: %d, train international station: %d. Train station: %d, trian line: %d", trains[j].status, all_stations_index, trains[j].station, trains[j].line);
                     // Put all trains that are waiting to load in the station to a buffer. Trains in this buffer will be randomly chosen
                     if (all_stations_index == i && trains[j].status == IN_STATION && trains[j].loading_time == WAITING_TO_LOAD){
@@ -955,10 +807,10 @@ void master() {
                 }
                 // Randomly pick a train index to start loading in this station
                 if (buffer_index > 0) {
-                    int random_buffer_index = rand() % buffer_index;
+                    int random_buffer_index = rng_draw(seed, RNG_STREAM_STATION_PICK, i, time_tick) % buffer_index;
                     int random_train_index = station_trains_buffer[random_buffer_index];
                     station_status[i] = LOADING;
-                    trains[random_train_index].loading_time = calculate_loadtime(all_stations_popularity_list[i]);
+                    trains[random_train_index].loading_time = calculate_loadtime(all_stations_popularity_list[i], seed, random_train_index, time_tick);
                     if (trains[random_train_index].line == GREEN) {
                         green_stations[trains[random_train_index].direction][trains[random_train_index].station] = LOADING;
                     } else if (trains[random_train_index].line == BLUE) {
@@ -989,8 +841,7 @@ void master() {
             }
             for (j = 0; j < num_green_stations; j++) {
                 if (green_stations[i][j] == READY_TO_LOAD) {
-                    int station_index = get_all_station_index(num_all_trains, j, G, all_stations_list);
-                    // fprintf(stderr, "The train [%d, %d] is waiting. Global index: %d. And idle at this iteration %d\n", i, j, station_index, time_tick);
+                    // fprintf(stderr, "The train [%d, %d] is waiting. And idle at this iteration %d\n", i, j, time_tick);
                     green_station_waiting_times[i][j] += 1;
                 }
             }
@@ -1012,22 +863,15 @@ void master() {
                 continue;
             }
             int **line_stations;
-            int all_stations_index;
-            int num_line_stations;
+            int all_stations_index = routes[trains[i].line].station[trains[i].station];
             if (trains[i].line == GREEN) {
                 line_stations = green_stations;
-                num_line_stations = num_green_stations;
-                all_stations_index = get_all_station_index(S, trains[i].station, G, all_stations_list);
             }   
             else if (trains[i].line == BLUE) {
                 line_stations = blue_stations;
-                num_line_stations = num_blue_stations;
-                all_stations_index = get_all_station_index(S, trains[i].station, B, all_stations_list);
             }
             else {
                 line_stations = yellow_stations;
-                num_line_stations = num_yellow_stations;
-                all_stations_index = get_all_station_index(S, trains[i].station, Y, all_stations_list);
             }
             // note(Marx): This is an intense debugging session that I spent too much time on
             // if (i == 0) {
@@ -1058,7 +902,7 @@ void master() {
             }
             // The update to move trains from transit into station --> ALREADY DONE AT SLAVE
         }
-        print_output(time_tick, trains, num_all_trains, G, Y, B, g, y, b, all_stations_list, S, num_green_stations, num_yellow_stations, num_blue_stations, fp);
+        print_output(time_tick, trains, num_all_trains, routes, g, y, fp);
         // fprintf(stderr, "\n\n");
 	}
     // Close clock for time
@@ -1098,19 +942,36 @@ void master() {
 /**
  * Train network using master-slave paradigm
  * The master initializes and sends the data to the 
- * The slaves represent a link each. And sends the necessary update to the network
- * Number of slaves must be equal to the number of links
+ * The slaves each represent a block of links. And sends the necessary update to the network
+ * Any number of slaves works, a slave can have many links (or none if there are more slaves than links)
  * Total number of processes is 1 + number of slaves
  **/
 int main(int argc, char ** argv)
 {
 	int nprocs;
+	int i;
 	MPI_Init(&argc,&argv);
 	MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
 	MPI_Comm_rank(MPI_COMM_WORLD, &myid);
+	// Every process reads the seed, so the slaves pick the same trains as in any other run with this seed.
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--seed=", 7) == 0) {
+			seed = strtoull(argv[i] + 7, NULL, 10);
+		} else if (strncmp(argv[i], "--input=", 8) == 0) {
+			input_name = argv[i] + 8;
+		}
+	}
 
 	// One master and nprocs-1 slaves
 	slaves = nprocs - 1;
+	if (slaves < 1) {
+		fprintf(stderr, "Error! Run it with at least 2 processes, one master and one slave\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	MPI_Type_contiguous(MSG_LINK_SIZE, MPI_INT, &link_row_type);
+	MPI_Type_commit(&link_row_type);
+	MPI_Type_contiguous(MSG_RESULT_SIZE, MPI_INT, &result_row_type);
+	MPI_Type_commit(&result_row_type);
 	if (myid == MASTER_ID) {
 		fprintf(stderr, " +++ Process %d is master\n", myid);
 		master();
@@ -0,0 +1,68 @@
+/*
+ * Turns a binary trace (parallel_assignment_1 --trace=bin or --trace=delta) back into the text log, byte for byte the
+ * log.txt the simulator writes with --trace=text (and the same run mode).
+ *
+ * Usage: trace_decode [--tick=T] [log.bin] [log.txt]
+ * With --tick=T, only the log line of time tick T is written, rebuilt from the last keyframe before it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "train_trace.h"
+
+int main(int argc, char *argv[]) {
+    int i;
+    int time_tick = -1;
+    char *in_name = "log.bin";
+    char *out_name = "log.txt";
+    int num_names = 0;
+    FILE *out;
+    struct trace_reader reader;
+
+    for (i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--tick=", 7) == 0) {
+            time_tick = atoi(argv[i] + 7);
+        } else if (num_names == 0) {
+            in_name = argv[i];
+            num_names++;
+        } else if (num_names == 1) {
+            out_name = argv[i];
+            num_names++;
+        } else {
+            printf("Error! Unknown option %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    if ((out = fopen(out_name, "w")) == NULL) {
+        printf("Error! opening file %s\n", out_name);
+        exit(1);
+    }
+    open_trace_reader(&reader, in_name);
+    char *line = (char*)malloc((size_t)reader.num_trains * TRACE_TOKEN_SIZE + 1);
+    int line_length = 0;
+
+    if (time_tick >= 0) {
+        replay_trace(&reader, time_tick);
+        line_length = format_trace_states(&reader, line);
+        fprintf(out, "%d:", time_tick);
+        fwrite(line, 1, line_length, out);
+        fputc('\n', out);
+    } else {
+        for (i = 0; i < reader.header.num_ticks; i++) {
+            // A repeated tick has the same line as the previous traced tick.
+            if (read_trace_tick(&reader) != TRACE_RECORD_REPEAT) {
+                line_length = format_trace_states(&reader, line);
+            }
+            fprintf(out, "%d:", reader.time_tick);
+            fwrite(line, 1, line_length, out);
+            fputc('\n', out);
+        }
+        // The summary follows the ticks as text.
+        fwrite(reader.data + reader.position, 1, reader.size - reader.position, out);
+    }
+
+    free(line);
+    close_trace_reader(&reader);
+    fclose(out);
+    return 0;
+}
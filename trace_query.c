@@ -0,0 +1,137 @@
+/*
+ * Prints the state of the network at a time tick, or the traced ticks of a range of time ticks, from a trace of parallel_assignment_1
+ * (log.txt, or log.bin of --trace=bin / --trace=delta) and its index (log.txt.idx, log.bin.idx).
+ * Both files are memory mapped. The last index entry before the first tick is found by binary search, so only the ticks
+ * from that entry on are read: the time taken depends on the keyframe interval and the length of the range, not on how
+ * far into the trace the range is.
+ *
+ * Usage: trace_query <trace> <first tick> [last tick]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "train_trace.h"
+
+/**
+ * Returns the last index entry at or before time_tick, or NULL if there is none.
+ */
+const struct trace_index_entry *find_index_entry(const struct trace_index_entry entries[], long long num_entries, int time_tick) {
+    long long low = 0;
+    long long high = num_entries;
+    // Find the first entry after time_tick.
+    while (low < high) {
+        long long middle = low + (high - low) / 2;
+        if (entries[middle].time_tick <= time_tick) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low == 0 ? NULL : &entries[low - 1];
+}
+
+void query_text_trace(const char *trace_name, const struct trace_index_entry *entry, int first_tick, int last_tick) {
+    size_t size;
+    const unsigned char *data = map_trace_file(trace_name, &size);
+    if (data == NULL) {
+        printf("Error! opening file %s\n", trace_name);
+        exit(1);
+    }
+    size_t position = entry == NULL ? 0 : entry->offset;
+    // Every line of the text trace is one traced tick, in order, and starts with its tick. The summary after the last
+    // tick starts with an empty line.
+    while (position < size && data[position] >= '0' && data[position] <= '9') {
+        int time_tick = atoi((const char*)data + position);
+        if (time_tick > last_tick) {
+            break;
+        }
+        const unsigned char *end = memchr(data + position, '\n', size - position);
+        size_t line_end = end == NULL ? size : (size_t)(end - data) + 1;
+        if (time_tick >= first_tick) {
+            fwrite(data + position, 1, line_end - position, stdout);
+        }
+        position = line_end;
+    }
+    unmap_trace_file(data, size);
+}
+
+void query_binary_trace(const char *trace_name, const struct trace_index_entry *entry, int first_tick, int last_tick) {
+    struct trace_reader reader;
+    int line_length = 0;
+    open_trace_reader(&reader, trace_name);
+    // Only the traced ticks in the range are printed, as in a text trace.
+    int step = reader.header.tick_step;
+    int trace_last_tick = reader.header.first_tick + (reader.header.num_ticks - 1) * step;
+    if (last_tick > trace_last_tick) {
+        last_tick = trace_last_tick;
+    }
+    if (first_tick < reader.header.first_tick) {
+        first_tick = reader.header.first_tick;
+    }
+    if (first_tick > last_tick) {
+        close_trace_reader(&reader);
+        return;
+    }
+    char *line = (char*)malloc((size_t)reader.num_trains * TRACE_TOKEN_SIZE + 1);
+    if (entry != NULL) {
+        seek_trace(&reader, entry->offset, entry->time_tick);
+    }
+    while (reader.time_tick < first_tick) {
+        read_trace_tick(&reader);
+    }
+    line_length = format_trace_states(&reader, line);
+    while (1) {
+        printf("%d:", reader.time_tick);
+        fwrite(line, 1, line_length, stdout);
+        putchar('\n');
+        if (reader.time_tick + step > last_tick) {
+            break;
+        }
+        // A repeated tick has the same line as the previous tick.
+        if (read_trace_tick(&reader) != TRACE_RECORD_REPEAT) {
+            line_length = format_trace_states(&reader, line);
+        }
+    }
+    free(line);
+    close_trace_reader(&reader);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 4) {
+        printf("Usage: %s <trace> <first tick> [last tick]\n", argv[0]);
+        exit(1);
+    }
+    char *trace_name = argv[1];
+    int first_tick = atoi(argv[2]);
+    int last_tick = argc == 4 ? atoi(argv[3]) : first_tick;
+    if (first_tick < 0 || last_tick < first_tick) {
+        printf("Error! Time ticks %d to %d are not a range of ticks\n", first_tick, last_tick);
+        exit(1);
+    }
+
+    char index_name[strlen(trace_name) + 5];
+    sprintf(index_name, "%s.idx", trace_name);
+    size_t index_size;
+    const unsigned char *index = map_trace_file(index_name, &index_size);
+    if (index == NULL) {
+        printf("Error! opening file %s\n", index_name);
+        exit(1);
+    }
+    if (index_size < TRACE_INDEX_HEADER_SIZE || memcmp(index, TRACE_INDEX_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "Error! Not a trace index\n");
+        exit(1);
+    }
+    int format;
+    memcpy(&format, index + TRACE_MAGIC_SIZE, sizeof(int));
+    const struct trace_index_entry *entries = (const struct trace_index_entry*)(index + TRACE_INDEX_HEADER_SIZE);
+    long long num_entries = (index_size - TRACE_INDEX_HEADER_SIZE) / sizeof(struct trace_index_entry);
+    const struct trace_index_entry *entry = find_index_entry(entries, num_entries, first_tick);
+
+    if (format == TRACE_FORMAT_TEXT) {
+        query_text_trace(trace_name, entry, first_tick, last_tick);
+    } else {
+        query_binary_trace(trace_name, entry, first_tick, last_tick);
+    }
+    unmap_trace_file(index, index_size);
+    return 0;
+}
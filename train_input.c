@@ -0,0 +1,678 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "train_input.h"
+
+#define INPUT_NUMBER_SIZE 64        // longest popularity that is read
+#define INPUT_ZERO_RUN "0 0 0 0 "
+#define INPUT_ZERO_RUN_SIZE 8
+#define INPUT_EDGES_MAGIC "TRNEDGES"
+#define INPUT_EDGES_MAGIC_SIZE 8
+
+// A link of the edge list, sorted into the row of the station it leaves from.
+struct input_edge
+{
+    int to;
+    int transit_time;
+};
+
+struct input_cursor
+{
+    const char *file_name;
+    const char *position;           // start of the current line
+    const char *end;                // end of the mapped file
+    const char *line_end;           // '\n' (or end of file) of the current line
+    int line_number;
+};
+
+// Open addressing hash table of the station names, only used while loading.
+struct name_table
+{
+    unsigned int mask;              // number of slots - 1, the number of slots is a power of two
+    int *station;                   // [slot] station whose name hashes there | -1
+};
+
+static void start_line(struct input_cursor *cursor) {
+    const char *newline = memchr(cursor->position, '\n', cursor->end - cursor->position);
+    cursor->line_end = newline == NULL ? cursor->end : newline;
+}
+
+static void next_line(struct input_cursor *cursor) {
+    cursor->position = cursor->line_end < cursor->end ? cursor->line_end + 1 : cursor->end;
+    cursor->line_number++;
+    start_line(cursor);
+}
+
+static int input_error(struct input_cursor *cursor, const char *what) {
+    fprintf(stderr, "Error! Line %d of %s: %s\n", cursor->line_number, cursor->file_name, what);
+    return -1;
+}
+
+/**
+ * Reads the int at p, after any blanks, like atoi. Returns the character after it, or NULL if there is no number
+ * before end.
+ */
+static const char *parse_int(const char *p, const char *end, int *value) {
+    int sign = 1;
+    int number = 0;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    if (p < end && (*p == '-' || *p == '+')) {
+        sign = *p == '-' ? -1 : 1;
+        p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+        return NULL;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        number = number * 10 + (*p - '0');
+        p++;
+    }
+    *value = sign * number;
+    return p;
+}
+
+/**
+ * Finds the next comma separated name of the line from *p on. Returns 0 at the end of the line. Empty names are
+ * skipped, as strtok does.
+ */
+static int next_name(const char **p, const char *line_end, const char **name, int *length) {
+    while (*p < line_end) {
+        const char *start = *p;
+        const char *comma = memchr(start, ',', line_end - start);
+        const char *stop = comma == NULL ? line_end : comma;
+        *p = comma == NULL ? line_end : comma + 1;
+        if (stop > start && stop[-1] == '\r') {
+            stop--;
+        }
+        if (stop > start) {
+            *name = start;
+            *length = stop - start;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned int hash_name(const char *name, int length) {
+    unsigned int hash = 2166136261u;
+    int i;
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Returns the slot of the name: the slot of the station with that name, or the empty slot where it would go.
+ */
+static unsigned int find_name_slot(struct name_table *table, char *station_names[], const char *name, int length) {
+    unsigned int slot = hash_name(name, length) & table->mask;
+    while (table->station[slot] >= 0) {
+        const char *station_name = station_names[table->station[slot]];
+        if (strncmp(station_name, name, length) == 0 && station_name[length] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & table->mask;
+    }
+    return slot;
+}
+
+static int read_station_names(struct input_cursor *cursor, struct network_input *input, struct name_table *table) {
+    int S = input->num_stations;
+    const char *p = cursor->position;
+    const char *name;
+    int length;
+    int i = 0;
+    // Every name and its '\0' fit in the space of the name and its comma.
+    input->name_arena = (char*)malloc(cursor->line_end - cursor->position + 1);
+    input->station_names = (char**)malloc(S * sizeof(char*));
+    char *arena = input->name_arena;
+    while (i < S && next_name(&p, cursor->line_end, &name, &length)) {
+        memcpy(arena, name, length);
+        arena[length] = '\0';
+        input->station_names[i] = arena;
+        arena += length + 1;
+        // A name that is given twice keeps its first station, as the linear search did.
+        unsigned int slot = find_name_slot(table, input->station_names, name, length);
+        if (table->station[slot] < 0) {
+            table->station[slot] = i;
+        }
+        i++;
+    }
+    if (i < S) {
+        return input_error(cursor, "fewer station names than stations");
+    }
+    next_line(cursor);
+    return 0;
+}
+
+/**
+ * Reads the S x S transit time matrix straight into the link graph, without keeping a row.
+ */
+static int read_transit_times(struct input_cursor *cursor, struct network_input *input) {
+    int S = input->num_stations;
+    int transit_time;
+    int i;
+    int j;
+    init_link_graph(&input->graph, S);
+    for (i = 0; i < S; i++) {
+        const char *p = cursor->position;
+        j = 0;
+        while (j < S) {
+            while (p < cursor->line_end && *p == ' ') {
+                p++;
+            }
+            // Most of the matrix is "0 0 0 ...", skip the zeros four at a time.
+            if (j + 4 <= S && cursor->line_end - p >= INPUT_ZERO_RUN_SIZE && memcmp(p, INPUT_ZERO_RUN, INPUT_ZERO_RUN_SIZE) == 0) {
+                p += INPUT_ZERO_RUN_SIZE;
+                j += 4;
+                continue;
+            }
+            p = parse_int(p, cursor->line_end, &transit_time);
+            if (p == NULL) {
+                return input_error(cursor, "fewer transit times than stations");
+            }
+            if (transit_time != 0) {
+                add_link(&input->graph, i, j, transit_time);
+            }
+            j++;
+        }
+        end_link_row(&input->graph, i);
+        next_line(cursor);
+    }
+    return 0;
+}
+
+static int compare_edges(const void *a, const void *b) {
+    return ((const struct input_edge*)a)->to - ((const struct input_edge*)b)->to;
+}
+
+/**
+ * Reads num_edges lines of "from,to,transit time" (station names) into the link graph. The edges can come in any
+ * order, they are bucketed by the station they leave from and sorted by the station they lead to, so only the links
+ * are ever held in memory, never a row of the matrix.
+ */
+static int read_edges(struct input_cursor *cursor, struct network_input *input, struct name_table *table, int num_edges) {
+    int S = input->num_stations;
+    int *from = (int*)malloc(num_edges * sizeof(int));
+    struct input_edge *edges = (struct input_edge*)malloc(num_edges * sizeof(struct input_edge));
+    struct input_edge *rows = (struct input_edge*)malloc(num_edges * sizeof(struct input_edge));
+    int *first_edge = (int*)calloc(S + 1, sizeof(int));
+    const char *name;
+    int length;
+    int result = 0;
+    int i;
+    int j;
+    for (i = 0; i < num_edges && result == 0; i++) {
+        const char *p = cursor->position;
+        int station[2];
+        for (j = 0; j < 2; j++) {
+            station[j] = -1;
+            if (next_name(&p, cursor->line_end, &name, &length)) {
+                station[j] = table->station[find_name_slot(table, input->station_names, name, length)];
+            }
+        }
+        if (station[0] < 0 || station[1] < 0 || station[0] == station[1]) {
+            result = input_error(cursor, "expected a link between two stations of the list of stations");
+        } else if (!next_name(&p, cursor->line_end, &name, &length) || parse_int(name, name + length, &edges[i].transit_time) != name + length || edges[i].transit_time <= 0) {
+            result = input_error(cursor, "expected the transit time of the link");
+        }
+        from[i] = station[0];
+        edges[i].to = station[1];
+        first_edge[station[0] + 1]++;
+        next_line(cursor);
+    }
+    if (result == 0) {
+        for (i = 0; i < S; i++) {
+            first_edge[i + 1] += first_edge[i];
+        }
+        for (i = 0; i < num_edges; i++) {
+            rows[first_edge[from[i]]++] = edges[i];
+        }
+        // first_edge[s] is now the end of row s, the start of row s + 1.
+        init_link_graph(&input->graph, S);
+        for (i = 0; i < S && result == 0; i++) {
+            int start = i == 0 ? 0 : first_edge[i - 1];
+            qsort(rows + start, first_edge[i] - start, sizeof(struct input_edge), compare_edges);
+            for (j = start; j < first_edge[i]; j++) {
+                if (j > start && rows[j].to == rows[j - 1].to) {
+                    fprintf(stderr, "Error! The link between stations %s and %s is given twice\n", input->station_names[i], input->station_names[rows[j].to]);
+                    result = -1;
+                    break;
+                }
+                add_link(&input->graph, i, rows[j].to, rows[j].transit_time);
+            }
+            end_link_row(&input->graph, i);
+        }
+    }
+    free(from);
+    free(edges);
+    free(rows);
+    free(first_edge);
+    return result;
+}
+
+static int read_popularity(struct input_cursor *cursor, struct network_input *input) {
+    char number[INPUT_NUMBER_SIZE];
+    const char *p = cursor->position;
+    int i;
+    input->popularity = (double*)malloc(input->num_stations * sizeof(double));
+    for (i = 0; i < input->num_stations; i++) {
+        while (p < cursor->line_end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            p++;
+        }
+        const char *start = p;
+        while (p < cursor->line_end && *p != ' ' && *p != '\t' && *p != '\r') {
+            p++;
+        }
+        if (p == start) {
+            return input_error(cursor, "fewer popularities than stations");
+        }
+        int length = p - start < INPUT_NUMBER_SIZE - 1 ? p - start : INPUT_NUMBER_SIZE - 1;
+        memcpy(number, start, length);
+        number[length] = '\0';
+        input->popularity[i] = strtod(number, NULL);
+    }
+    next_line(cursor);
+    return 0;
+}
+
+static int read_line_stations(struct input_cursor *cursor, struct network_input *input, struct name_table *table, int line) {
+    const char *p = cursor->position;
+    const char *name;
+    int length;
+    int num_stations = 0;
+    // A line has at most one station more than commas.
+    int capacity = 1;
+    const char *comma = p;
+    while ((comma = memchr(comma, ',', cursor->line_end - comma)) != NULL) {
+        capacity++;
+        comma++;
+    }
+    input->line_stations[line] = (int*)malloc(capacity * sizeof(int));
+    input->line_station_names[line] = (char**)malloc(capacity * sizeof(char*));
+    while (next_name(&p, cursor->line_end, &name, &length)) {
+        int station = table->station[find_name_slot(table, input->station_names, name, length)];
+        if (station < 0) {
+            fprintf(stderr, "Error! Station %.*s of a line is not in the list of stations\n", length, name);
+            return -1;
+        }
+        input->line_stations[line][num_stations] = station;
+        input->line_station_names[line][num_stations] = input->station_names[station];
+        num_stations++;
+    }
+    if (num_stations < 2) {
+        return input_error(cursor, "a line needs two stations at least");
+    }
+    input->num_line_stations[line] = num_stations;
+    next_line(cursor);
+    return 0;
+}
+
+static int read_train_counts(struct input_cursor *cursor, struct network_input *input) {
+    const char *p = cursor->position;
+    int line;
+    for (line = 0; line < 3; line++) {
+        p = parse_int(p, cursor->line_end, &input->num_line_trains[line]);
+        if (p == NULL) {
+            return input_error(cursor, "expected the number of green, yellow and blue trains");
+        }
+        while (p < cursor->line_end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+    }
+    return 0;
+}
+
+static int read_network_input(struct input_cursor *cursor, struct network_input *input) {
+    int line;
+    int num_edges = -1;
+    const char *p = cursor->position;
+    // An edge list starts with its magic, the matrix format with the number of stations.
+    if (cursor->line_end - p >= INPUT_EDGES_MAGIC_SIZE && memcmp(p, INPUT_EDGES_MAGIC, INPUT_EDGES_MAGIC_SIZE) == 0) {
+        p = parse_int(p + INPUT_EDGES_MAGIC_SIZE, cursor->line_end, &input->num_stations);
+        if (p == NULL || parse_int(p, cursor->line_end, &num_edges) == NULL || num_edges < 0) {
+            return input_error(cursor, "expected the number of stations and of links after " INPUT_EDGES_MAGIC);
+        }
+    } else if (parse_int(p, cursor->line_end, &input->num_stations) == NULL) {
+        return input_error(cursor, "expected the number of stations");
+    }
+    if (input->num_stations < 2) {
+        return input_error(cursor, "a network needs two stations at least");
+    }
+    next_line(cursor);
+
+    struct name_table table;
+    table.mask = 1;
+    while (table.mask < 2 * (unsigned int)input->num_stations) {
+        table.mask <<= 1;
+    }
+    table.station = (int*)malloc(table.mask * sizeof(int));
+    memset(table.station, -1, table.mask * sizeof(int));
+    table.mask--;
+    int result = read_station_names(cursor, input, &table);
+    if (num_edges >= 0) {
+        if (result == 0) {
+            result = read_popularity(cursor, input);
+        }
+        if (result == 0) {
+            result = read_edges(cursor, input, &table, num_edges);
+        }
+    } else {
+        if (result == 0) {
+            result = read_transit_times(cursor, input);
+        }
+        if (result == 0) {
+            result = read_popularity(cursor, input);
+        }
+    }
+    for (line = 0; line < 3 && result == 0; line++) {
+        result = read_line_stations(cursor, input, &table, line);
+    }
+    free(table.station);
+    if (result != 0) {
+        return result;
+    }
+
+    if (parse_int(cursor->position, cursor->line_end, &input->num_ticks) == NULL) {
+        return input_error(cursor, "expected the number of time ticks");
+    }
+    next_line(cursor);
+    result = read_train_counts(cursor, input);
+    for (line = 0; line < 3 && result == 0; line++) {
+        result = build_route_table(&input->routes[line], input->line_stations[line], input->num_line_stations[line], input->station_names, &input->graph);
+    }
+    return result;
+}
+
+static int snapshot_section_fits(struct network_snapshot_header *header, long long offset, long long size) {
+    return offset >= (long long)sizeof(struct network_snapshot_header) && offset % NETWORK_SNAPSHOT_ALIGN == 0 && size >= 0 && offset + size <= header->size;
+}
+
+/**
+ * Checks the link graph of a snapshot: the links of every station are in its row, and lead to a station with a transit
+ * time greater than 0.
+ */
+static int snapshot_graph_is_valid(struct link_graph *graph) {
+    int station;
+    int link;
+    if (graph->first_link[0] != 0 || graph->first_link[graph->num_stations] != graph->num_links) {
+        return 0;
+    }
+    for (station = 0; station < graph->num_stations; station++) {
+        if (graph->first_link[station + 1] < graph->first_link[station]) {
+            return 0;
+        }
+        for (link = graph->first_link[station]; link < graph->first_link[station + 1]; link++) {
+            if (graph->from[link] != station || graph->to[link] < 0 || graph->to[link] >= graph->num_stations || graph->transit_time[link] <= 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Checks a route table of a snapshot against its link graph, as build_route_table would have filled it.
+ */
+static int snapshot_route_is_valid(struct route_table *route, struct link_graph *graph) {
+    int i;
+    int direction;
+    for (i = 0; i < route->num_stations; i++) {
+        if (route->station[i] < 0 || route->station[i] >= graph->num_stations) {
+            return 0;
+        }
+    }
+    for (direction = 0; direction < 2; direction++) {
+        for (i = 0; i < route->num_stations; i++) {
+            int next_station = route->next_station[direction][i];
+            int link = route->link[direction][i];
+            if (next_station != route_next_station(i, direction, route->num_stations) || route->next_global_station[direction][i] != route->station[next_station]) {
+                return 0;
+            }
+            if (link < 0 || link >= graph->num_links || graph->from[link] != route->station[i] || graph->to[link] != route->station[next_station] || route->transit_time[direction][i] != graph->transit_time[link]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Points input into the snapshot mapped at data. Returns -1 if the snapshot was not written by this version, on a
+ * host with the same byte order, or is cut short or damaged.
+ */
+static int load_network_snapshot(struct network_input *input, char *data, size_t size, const char *file_name) {
+    struct network_snapshot_header *header = (struct network_snapshot_header*)data;
+    int S;
+    int i;
+    int line;
+    if (size < sizeof(struct network_snapshot_header) || header->version != NETWORK_SNAPSHOT_VERSION || header->byte_order != NETWORK_SNAPSHOT_BYTE_ORDER) {
+        fprintf(stderr, "Error! %s is a snapshot of another version or byte order, compile it again\n", file_name);
+        return -1;
+    }
+    S = header->num_stations;
+    int fits = header->size == (long long)size && S >= 2 && header->num_links >= 0 && header->num_ticks >= 0;
+    fits = fits && snapshot_section_fits(header, header->names, header->names_size) && header->names_size > 0;
+    fits = fits && snapshot_section_fits(header, header->name_offsets, S * (long long)sizeof(int));
+    fits = fits && snapshot_section_fits(header, header->popularity, S * (long long)sizeof(double));
+    fits = fits && snapshot_section_fits(header, header->first_link, (S + 1) * (long long)sizeof(int));
+    fits = fits && snapshot_section_fits(header, header->from, header->num_links * (long long)sizeof(int));
+    fits = fits && snapshot_section_fits(header, header->to, header->num_links * (long long)sizeof(int));
+    fits = fits && snapshot_section_fits(header, header->transit_time, header->num_links * (long long)sizeof(int));
+    for (line = 0; line < 3; line++) {
+        fits = fits && header->num_line_stations[line] >= 2 && header->num_line_trains[line] >= 0 && snapshot_section_fits(header, header->routes[line], NETWORK_SNAPSHOT_ROUTE_ARRAYS * header->num_line_stations[line] * (long long)sizeof(int));
+    }
+    if (!fits || data[header->names + header->names_size - 1] != '\0') {
+        fprintf(stderr, "Error! The snapshot %s is damaged\n", file_name);
+        return -1;
+    }
+
+    memset(input, 0, sizeof(struct network_input));
+    input->snapshot = data;
+    input->snapshot_size = size;
+    input->num_stations = S;
+    input->num_ticks = header->num_ticks;
+    input->name_arena = data + header->names;
+    input->popularity = (double*)(data + header->popularity);
+    int *name_offsets = (int*)(data + header->name_offsets);
+    input->station_names = (char**)malloc(S * sizeof(char*));
+    for (i = 0; i < S; i++) {
+        if (name_offsets[i] < 0 || name_offsets[i] >= header->names_size) {
+            fprintf(stderr, "Error! The snapshot %s is damaged\n", file_name);
+            return -1;
+        }
+        input->station_names[i] = input->name_arena + name_offsets[i];
+    }
+    input->graph.num_stations = S;
+    input->graph.num_links = header->num_links;
+    input->graph.capacity = header->num_links;
+    input->graph.first_link = (int*)(data + header->first_link);
+    input->graph.from = (int*)(data + header->from);
+    input->graph.to = (int*)(data + header->to);
+    input->graph.transit_time = (int*)(data + header->transit_time);
+    if (!snapshot_graph_is_valid(&input->graph)) {
+        fprintf(stderr, "Error! The snapshot %s is damaged\n", file_name);
+        return -1;
+    }
+    for (line = 0; line < 3; line++) {
+        int num_stations = header->num_line_stations[line];
+        int *arrays = (int*)(data + header->routes[line]);
+        struct route_table *route = &input->routes[line];
+        input->num_line_trains[line] = header->num_line_trains[line];
+        input->num_line_stations[line] = num_stations;
+        route->num_stations = num_stations;
+        route->station = arrays;
+        route->next_station[LEFT] = arrays + num_stations;
+        route->next_station[RIGHT] = arrays + 2 * num_stations;
+        route->next_global_station[LEFT] = arrays + 3 * num_stations;
+        route->next_global_station[RIGHT] = arrays + 4 * num_stations;
+        route->link[LEFT] = arrays + 5 * num_stations;
+        route->link[RIGHT] = arrays + 6 * num_stations;
+        route->transit_time[LEFT] = arrays + 7 * num_stations;
+        route->transit_time[RIGHT] = arrays + 8 * num_stations;
+        input->line_stations[line] = route->station;
+        if (!snapshot_route_is_valid(route, &input->graph)) {
+            fprintf(stderr, "Error! The snapshot %s is damaged\n", file_name);
+            return -1;
+        }
+        input->line_station_names[line] = (char**)malloc(num_stations * sizeof(char*));
+        for (i = 0; i < num_stations; i++) {
+            input->line_station_names[line][i] = input->station_names[route->station[i]];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Loads the network of file_name: a snapshot, or a network in the matrix or the edge list format. Returns 0 on
+ * success and -1 (after printing why) if the file can not be read or is in none of these formats.
+ */
+int load_network_input(struct network_input *input, const char *file_name) {
+    struct stat status;
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &status) != 0 || status.st_size == 0) {
+        fprintf(stderr, "Error! opening file %s\n", file_name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    // A private writable mapping, so that the arrays of a snapshot can be handed out as they are. Pages are only copied
+    // if they are written to.
+    char *data = mmap(NULL, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error! opening file %s\n", file_name);
+        return -1;
+    }
+    if (status.st_size >= NETWORK_SNAPSHOT_MAGIC_SIZE && memcmp(data, NETWORK_SNAPSHOT_MAGIC, NETWORK_SNAPSHOT_MAGIC_SIZE) == 0) {
+        if (load_network_snapshot(input, data, status.st_size, file_name) != 0) {
+            munmap(data, status.st_size);
+            return -1;
+        }
+        return 0;
+    }
+    madvise(data, status.st_size, MADV_SEQUENTIAL);
+
+    memset(input, 0, sizeof(struct network_input));
+    struct input_cursor cursor = {file_name, data, data + status.st_size, NULL, 1};
+    start_line(&cursor);
+    int result = read_network_input(&cursor, input);
+    munmap(data, status.st_size);
+    return result;
+}
+
+void free_network_input(struct network_input *input) {
+    int line;
+    free(input->station_names);
+    for (line = 0; line < 3; line++) {
+        free(input->line_station_names[line]);
+    }
+    if (input->snapshot != NULL) {
+        munmap(input->snapshot, input->snapshot_size);
+        return;
+    }
+    free(input->name_arena);
+    free(input->popularity);
+    free_link_graph(&input->graph);
+    for (line = 0; line < 3; line++) {
+        free(input->line_stations[line]);
+        free_route_table(&input->routes[line]);
+    }
+}
+
+static void append_snapshot_data(FILE *fp, long long *offset, const void *data, long long length) {
+    fwrite(data, 1, length, fp);
+    *offset += length;
+}
+
+/**
+ * Writes a section of length bytes at *offset, after padding the snapshot to NETWORK_SNAPSHOT_ALIGN, and returns
+ * its offset.
+ */
+static long long write_snapshot_section(FILE *fp, long long *offset, const void *data, long long length) {
+    static const char padding[NETWORK_SNAPSHOT_ALIGN] = {0};
+    long long start = (*offset + NETWORK_SNAPSHOT_ALIGN - 1) / NETWORK_SNAPSHOT_ALIGN * NETWORK_SNAPSHOT_ALIGN;
+    append_snapshot_data(fp, offset, padding, start - *offset);
+    append_snapshot_data(fp, offset, data, length);
+    return start;
+}
+
+/**
+ * Writes the network to file_name as a snapshot that load_network_input maps instead of parsing. Returns 0 on
+ * success and -1 if the file can not be written.
+ */
+int write_network_snapshot(struct network_input *input, const char *file_name) {
+    struct network_snapshot_header header;
+    int S = input->num_stations;
+    int num_links = input->graph.num_links;
+    int i;
+    int line;
+    FILE *fp = fopen(file_name, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error! opening file %s\n", file_name);
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, NETWORK_SNAPSHOT_MAGIC, NETWORK_SNAPSHOT_MAGIC_SIZE);
+    header.version = NETWORK_SNAPSHOT_VERSION;
+    header.byte_order = NETWORK_SNAPSHOT_BYTE_ORDER;
+    header.num_stations = S;
+    header.num_links = num_links;
+    header.num_ticks = input->num_ticks;
+    for (line = 0; line < 3; line++) {
+        header.num_line_trains[line] = input->num_line_trains[line];
+        header.num_line_stations[line] = input->num_line_stations[line];
+    }
+    // The header is written again at the end, with the offsets of the sections.
+    fwrite(&header, sizeof(header), 1, fp);
+    long long offset = sizeof(header);
+
+    int *name_offsets = (int*)malloc(S * sizeof(int));
+    long long names_size = 0;
+    for (i = 0; i < S; i++) {
+        name_offsets[i] = names_size;
+        names_size += strlen(input->station_names[i]) + 1;
+    }
+    header.names = write_snapshot_section(fp, &offset, input->station_names[0], strlen(input->station_names[0]) + 1);
+    header.names_size = names_size;
+    for (i = 1; i < S; i++) {
+        append_snapshot_data(fp, &offset, input->station_names[i], strlen(input->station_names[i]) + 1);
+    }
+    header.name_offsets = write_snapshot_section(fp, &offset, name_offsets, S * sizeof(int));
+    free(name_offsets);
+    header.popularity = write_snapshot_section(fp, &offset, input->popularity, S * sizeof(double));
+    header.first_link = write_snapshot_section(fp, &offset, input->graph.first_link, (S + 1) * sizeof(int));
+    header.from = write_snapshot_section(fp, &offset, input->graph.from, num_links * sizeof(int));
+    header.to = write_snapshot_section(fp, &offset, input->graph.to, num_links * sizeof(int));
+    header.transit_time = write_snapshot_section(fp, &offset, input->graph.transit_time, num_links * sizeof(int));
+    for (line = 0; line < 3; line++) {
+        struct route_table *route = &input->routes[line];
+        long long length = route->num_stations * sizeof(int);
+        // The nine arrays of a route table follow each other without padding.
+        header.routes[line] = write_snapshot_section(fp, &offset, route->station, length);
+        append_snapshot_data(fp, &offset, route->next_station[LEFT], length);
+        append_snapshot_data(fp, &offset, route->next_station[RIGHT], length);
+        append_snapshot_data(fp, &offset, route->next_global_station[LEFT], length);
+        append_snapshot_data(fp, &offset, route->next_global_station[RIGHT], length);
+        append_snapshot_data(fp, &offset, route->link[LEFT], length);
+        append_snapshot_data(fp, &offset, route->link[RIGHT], length);
+        append_snapshot_data(fp, &offset, route->transit_time[LEFT], length);
+        append_snapshot_data(fp, &offset, route->transit_time[RIGHT], length);
+    }
+    header.size = offset;
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error! writing file %s\n", file_name);
+        return -1;
+    }
+    return 0;
+}
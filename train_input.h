@@ -0,0 +1,97 @@
+/*
+ * Loader of input.txt, shared by the OpenMP and MPI simulators.
+ *
+ * The file is memory mapped and tokenized in a single pass, without any limit on the length of a line or of a station
+ * name:
+ *     S
+ *     name,name,...                    (S station names)
+ *     S rows of S transit times        (0 for no link)
+ *     S popularities
+ *     green line, yellow line, blue line (station names, comma separated)
+ *     number of time ticks
+ *     g,y,b                            (number of green, yellow and blue trains)
+ * A network of many stations can instead be given as an edge list, told apart by its first line:
+ *     TRNEDGES S E
+ *     name,name,...                    (S station names)
+ *     S popularities
+ *     E lines of from,to,transit time  (station names, one line per direction of a link, in any order)
+ *     green line, yellow line, blue line
+ *     number of time ticks
+ *     g,y,b
+ * The links go straight into the link graph, no S x S matrix is ever built.
+ *
+ * The names of all stations are copied once into one arena. The stations of the lines are looked up in a hash table
+ * of the names while loading, so every line comes out as global station indices (and as pointers to the names in the
+ * arena, for the code that still prints names). The rows of the matrix go straight into the link graph, and the route
+ * table of every line is built once the links are known.
+ *
+ * SNAPSHOT: network_compile writes a loaded network to a binary snapshot (write_network_snapshot), which
+ * load_network_input tells apart by its magic. A snapshot is a network_snapshot_header followed by sections at the
+ * offsets of the header, 8 byte aligned: the station names ('\0' ended), the offset of every name, the popularities,
+ * the four arrays of the link graph and, for each line, the nine arrays of its route table (station, next_station,
+ * next_global_station, link, transit_time, left then right). All numbers are in the byte order of the host that wrote
+ * it. A snapshot is mapped and used in place: the link graph and the route tables point into the mapping, nothing is
+ * parsed and only the arrays of name pointers are allocated.
+ */
+#ifndef TRAIN_INPUT_H
+#define TRAIN_INPUT_H
+
+#include "train_network.h"
+
+#define INPUT_GREEN 0
+#define INPUT_YELLOW 1
+#define INPUT_BLUE 2
+
+#define NETWORK_SNAPSHOT_MAGIC "TRNSNAPS"
+#define NETWORK_SNAPSHOT_MAGIC_SIZE 8
+#define NETWORK_SNAPSHOT_VERSION 1
+#define NETWORK_SNAPSHOT_BYTE_ORDER 0x01020304
+#define NETWORK_SNAPSHOT_ALIGN 8
+#define NETWORK_SNAPSHOT_ROUTE_ARRAYS 9
+
+struct network_snapshot_header
+{
+    char magic[NETWORK_SNAPSHOT_MAGIC_SIZE];
+    int version;
+    int byte_order;                 // NETWORK_SNAPSHOT_BYTE_ORDER, as written by the host
+    int num_stations;
+    int num_links;
+    int num_ticks;
+    int num_line_trains[3];
+    int num_line_stations[3];
+    int reserved;
+    long long size;                 // bytes of the whole snapshot
+    // Offsets of the sections from the start of the snapshot
+    long long names;                // char [names_size]
+    long long names_size;
+    long long name_offsets;         // int [station] offset of the name in names
+    long long popularity;           // double [station]
+    long long first_link;           // int [station + 1]
+    long long from;                 // int [link]
+    long long to;                   // int [link]
+    long long transit_time;         // int [link]
+    long long routes[3];            // int [NETWORK_SNAPSHOT_ROUTE_ARRAYS][local station] of each line
+};
+
+struct network_input
+{
+    int num_stations;
+    char *name_arena;               // names of all stations, one after the other, each ended by '\0'
+    char **station_names;           // [station] -> name in name_arena
+    double *popularity;             // [station]
+    struct link_graph graph;
+    int num_line_stations[3];       // [INPUT_GREEN | INPUT_YELLOW | INPUT_BLUE]
+    int *line_stations[3];          // [line][local station] -> global station
+    char **line_station_names[3];   // [line][local station] -> name in name_arena
+    int num_ticks;
+    int num_line_trains[3];         // [line] number of trains
+    struct route_table routes[3];   // [line]
+    void *snapshot;                 // the mapped snapshot the arrays point into, NULL if the network was parsed
+    size_t snapshot_size;
+};
+
+int load_network_input(struct network_input *input, const char *file_name);
+void free_network_input(struct network_input *input);
+int write_network_snapshot(struct network_input *input, const char *file_name);
+
+#endif
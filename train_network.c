@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "train_network.h"
+
+/**
+ * Local index of the station after prev_station in direction. Trains turn around at the terminals.
+ */
+int route_next_station(int prev_station, int direction, int num_stations) {
+    if (direction == RIGHT) {
+        // Reached the end of the station
+        if (prev_station == num_stations - 1) {
+            return prev_station - 1;
+        }
+        return prev_station + 1;
+    }
+    // Reached the start of the station
+    if (prev_station == 0) {
+        return 1;
+    }
+    return prev_station - 1;
+}
+
+void init_link_graph(struct link_graph *graph, int S) {
+    graph->num_stations = S;
+    graph->num_links = 0;
+    graph->capacity = S + 1;
+    graph->first_link = (int*)malloc((S + 1) * sizeof(int));
+    graph->from = (int*)malloc(graph->capacity * sizeof(int));
+    graph->to = (int*)malloc(graph->capacity * sizeof(int));
+    graph->transit_time = (int*)malloc(graph->capacity * sizeof(int));
+    graph->first_link[0] = 0;
+}
+
+/**
+ * Adds the link from -> to. Links must be added in order of from and then of to, and the links of a station are
+ * closed with end_link_row.
+ */
+void add_link(struct link_graph *graph, int from, int to, int transit_time) {
+    if (graph->num_links == graph->capacity) {
+        graph->capacity *= 2;
+        graph->from = (int*)realloc(graph->from, graph->capacity * sizeof(int));
+        graph->to = (int*)realloc(graph->to, graph->capacity * sizeof(int));
+        graph->transit_time = (int*)realloc(graph->transit_time, graph->capacity * sizeof(int));
+    }
+    graph->from[graph->num_links] = from;
+    graph->to[graph->num_links] = to;
+    graph->transit_time[graph->num_links] = transit_time;
+    graph->num_links++;
+}
+
+/**
+ * Ends the links leaving station from. Every station must be ended, in order, starting from 0.
+ */
+void end_link_row(struct link_graph *graph, int from) {
+    graph->first_link[from + 1] = graph->num_links;
+}
+
+/**
+ * Returns the id of the link between from and to, or NO_LINK. Binary search over the links leaving from.
+ */
+int find_link(struct link_graph *graph, int from, int to) {
+    int low = graph->first_link[from];
+    int high = graph->first_link[from + 1] - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (graph->to[middle] == to) {
+            return middle;
+        } else if (graph->to[middle] < to) {
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    return NO_LINK;
+}
+
+void free_link_graph(struct link_graph *graph) {
+    free(graph->first_link);
+    free(graph->from);
+    free(graph->to);
+    free(graph->transit_time);
+}
+
+/**
+ * Builds the route table of a line, given the global index of each of its stations. Returns 0 on success and -1 if
+ * two consecutive stations of the line have no link between them.
+ */
+int build_route_table(struct route_table *route, int line_stations[], int num_stations, char *all_stations_list[], struct link_graph *graph) {
+    int i;
+    int direction;
+
+    route->num_stations = num_stations;
+    route->station = (int*)malloc(num_stations * sizeof(int));
+    memcpy(route->station, line_stations, num_stations * sizeof(int));
+    for (direction = 0; direction < 2; direction++) {
+        route->next_station[direction] = (int*)malloc(num_stations * sizeof(int));
+        route->next_global_station[direction] = (int*)malloc(num_stations * sizeof(int));
+        route->link[direction] = (int*)malloc(num_stations * sizeof(int));
+        route->transit_time[direction] = (int*)malloc(num_stations * sizeof(int));
+        for (i = 0; i < num_stations; i++) {
+            int next_station = route_next_station(i, direction, num_stations);
+            int from = route->station[i];
+            int to = route->station[next_station];
+            route->next_station[direction][i] = next_station;
+            route->next_global_station[direction][i] = to;
+            route->link[direction][i] = find_link(graph, from, to);
+            if (route->link[direction][i] == NO_LINK) {
+                fprintf(stderr, "Error! There is no link between stations %s and %s of a line\n", all_stations_list[from], all_stations_list[to]);
+                return -1;
+            }
+            route->transit_time[direction][i] = graph->transit_time[route->link[direction][i]];
+        }
+    }
+    return 0;
+}
+
+void free_route_table(struct route_table *route) {
+    int direction;
+    free(route->station);
+    for (direction = 0; direction < 2; direction++) {
+        free(route->next_station[direction]);
+        free(route->next_global_station[direction]);
+        free(route->link[direction]);
+        free(route->transit_time[direction]);
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * Shared network structures used by the OpenMP and MPI simulators.
+ *
+ * ROUTE TABLES:
+ * Every line is turned into a route table once the input has been loaded (train_input.h). For each local station index of
+ * the line and each direction, the table holds the global station index, the next station (local and global), the id of
+ * the link between them and its transit time. The simulators only read from these tables while ticking, so no station
+ * names are compared after start up.
+ *
+ * LINK GRAPH:
+ * Links are kept as a compressed sparse row graph. Links are numbered densely in row major order of the non zero entries
+ * of the S x S transit time matrix, so the links leaving station s are first_link[s] .. first_link[s + 1] - 1, sorted by
+ * the station they lead to. The input matrix is added one row at a time (or one link at a time) and never stored. State
+ * of a link (used / empty, claims, ...) is kept in arrays indexed by link id. (The MPI engine hands links out to slaves
+ * in the same order.)
+ */
+#ifndef TRAIN_NETWORK_H
+#define TRAIN_NETWORK_H
+
+// Direction
+#define LEFT 0      // FROM END OF ARRAY TO START
+#define RIGHT 1     // FROM START OF ARRAY TO END
+
+#define NO_LINK -1
+
+struct link_graph
+{
+    int num_stations;
+    int num_links;
+    int capacity;                   // number of links the arrays below have room for
+    int *first_link;                // [station] first link leaving the station. first_link[num_stations] == num_links
+    int *from;                      // [link] global index of the station the link leaves from
+    int *to;                        // [link] global index of the station the link leads to
+    int *transit_time;              // [link] transit time of the link
+};
+
+struct route_table
+{
+    int num_stations;
+    int *station;                   // global index of each local station
+    int *next_station[2];           // [direction][local station] -> local index of the next station
+    int *next_global_station[2];    // [direction][local station] -> global index of the next station
+    int *link[2];                   // [direction][local station] -> id of the link to the next station | NO_LINK
+    int *transit_time[2];           // [direction][local station] -> transit time of the link to the next station
+};
+
+void init_link_graph(struct link_graph *graph, int S);
+void add_link(struct link_graph *graph, int from, int to, int transit_time);
+void end_link_row(struct link_graph *graph, int from);
+int find_link(struct link_graph *graph, int from, int to);
+void free_link_graph(struct link_graph *graph);
+
+int route_next_station(int prev_station, int direction, int num_stations);
+int build_route_table(struct route_table *route, int line_stations[], int num_stations, char *all_stations_list[],
+                      struct link_graph *graph);
+void free_route_table(struct route_table *route);
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Counter based random numbers shared by the simulators.
+ *
+ * A draw is a pure function of (seed, stream, id, time tick), computed with the Philox4x32-10 generator. There is no hidden
+ * state, so draws need no locks, can be made from any thread or process in any order, and loops of draws can be vectorized.
+ * The same seed gives the same load times in the OpenMP and MPI engines.
+ */
+#ifndef TRAIN_RNG_H
+#define TRAIN_RNG_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define RNG_DEFAULT_SEED 1
+
+// Streams. Every stream is keyed by its own kind of id.
+#define RNG_STREAM_LOAD_TIME 0      // id: global index of the train
+#define RNG_STREAM_LINK_PICK 1      // id: link id
+#define RNG_STREAM_STATION_PICK 2   // id: global index of the station
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+static inline uint32_t rng_draw(uint64_t seed, uint32_t stream, uint32_t id, uint32_t time_tick) {
+    uint32_t c0 = id;
+    uint32_t c1 = time_tick;
+    uint32_t c2 = stream;
+    uint32_t c3 = 0;
+    uint32_t k0 = (uint32_t)seed;
+    uint32_t k1 = (uint32_t)(seed >> 32);
+    int round;
+    for (round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+    return c0;
+}
+
+/**
+ * Loading time of a train that starts loading at a station with the given popularity in the given time tick.
+ */
+static inline int calculate_loadtime(double popularity, uint64_t seed, int train_number, int time_tick) {
+    double random_number;
+    random_number = (rng_draw(seed, RNG_STREAM_LOAD_TIME, train_number, time_tick) % 10) + 1;
+    return ceil(random_number * popularity);
+}
+
+#endif
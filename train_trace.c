@@ -0,0 +1,707 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "train_network.h"
+#include "train_trace.h"
+
+static size_t write_all(int fd, struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error! writing the trace: %s\n", strerror(errno));
+            exit(1);
+        }
+        total += written;
+        // Skip what was written, a short write can stop in the middle of a buffer.
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return total;
+}
+
+#ifdef TRACE_ZSTD
+/**
+ * Compresses the filled part of the block into the zstd frame and writes out what the compressor hands back. With
+ * ZSTD_e_end, the frame is closed.
+ */
+static void compress_trace_block(struct trace_writer *writer, ZSTD_EndDirective mode) {
+    ZSTD_inBuffer in = {writer->block, writer->block_length, 0};
+    size_t remaining;
+    do {
+        ZSTD_outBuffer out = {writer->compressed, writer->compressed_capacity, 0};
+        remaining = ZSTD_compressStream2(writer->compressor, &out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            fprintf(stderr, "Error! compressing the trace: %s\n", ZSTD_getErrorName(remaining));
+            exit(1);
+        }
+        struct iovec iov = {writer->compressed, out.pos};
+        write_all(writer->fd, &iov, 1);
+    } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    writer->block_length = 0;
+}
+#endif
+
+/**
+ * Writes the buffers to the trace, through the compressor if the trace is compressed. The offsets in the trace are the
+ * offsets before compression.
+ */
+static void emit_trace(struct trace_writer *writer, struct iovec *iov, int iovcnt) {
+#ifdef TRACE_ZSTD
+    if (writer->compress) {
+        int i;
+        for (i = 0; i < iovcnt; i++) {
+            const char *data = (const char*)iov[i].iov_base;
+            size_t length = iov[i].iov_len;
+            writer->offset += length;
+            // Fill fixed size blocks and compress each block once it is full.
+            while (length > 0) {
+                size_t room = TRACE_BLOCK_SIZE - writer->block_length;
+                size_t part = length < room ? length : room;
+                memcpy(writer->block + writer->block_length, data, part);
+                writer->block_length += part;
+                data += part;
+                length -= part;
+                if (writer->block_length == TRACE_BLOCK_SIZE) {
+                    compress_trace_block(writer, ZSTD_e_continue);
+                }
+            }
+        }
+        return;
+    }
+#endif
+    writer->offset += write_all(writer->fd, iov, iovcnt);
+}
+
+/**
+ * Adds time_tick to the index if the tick about to be written can be read on its own (a text line or a keyframe) and
+ * the last entry is at least a keyframe interval before it.
+ */
+static void index_trace_tick(struct trace_writer *writer, int time_tick) {
+    struct trace_index_entry entry;
+    if (writer->index == NULL || (writer->last_indexed_tick >= 0 && time_tick < writer->last_indexed_tick + writer->keyframe_interval)) {
+        return;
+    }
+    entry.time_tick = time_tick;
+    entry.offset = writer->offset;
+    fwrite(&entry, sizeof(entry), 1, writer->index);
+    writer->last_indexed_tick = time_tick;
+}
+
+static char *append_number(char *out, int value) {
+    char digits[12];
+    int num_digits = 0;
+    do {
+        digits[num_digits++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    while (num_digits > 0) {
+        *out++ = digits[--num_digits];
+    }
+    return out;
+}
+
+/**
+ * Appends the " g<train>-s<station>," or " g<train>-s<station>->s<station>," token of a train to out and returns the end
+ * of the token. The numbers must not be negative.
+ */
+char *append_train_position(char *out, char line_letter, int train_index, int from_station, int to_station) {
+    *out++ = ' ';
+    *out++ = line_letter;
+    out = append_number(out, train_index);
+    *out++ = '-';
+    *out++ = 's';
+    out = append_number(out, from_station);
+    if (to_station != TRACE_IN_STATION) {
+        *out++ = '-';
+        *out++ = '>';
+        *out++ = 's';
+        out = append_number(out, to_station);
+    }
+    *out++ = ',';
+    return out;
+}
+
+/**
+ * Appends value to out as a little endian base 128 varint (7 bits per byte, high bit set on every byte but the last), and
+ * returns the end of the varint.
+ */
+char *append_varint(char *out, unsigned int value) {
+    while (value >= 0x80) {
+        *out++ = (char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (char)value;
+    return out;
+}
+
+static void write_binary_slot(struct trace_writer *writer, struct trace_slot *slot) {
+    int i;
+    int length = 0;
+    int record = TRACE_RECORD_REPEAT;
+    int iovcnt = 1;
+    if (!slot->repeat) {
+        for (i = 0; i < writer->num_segments; i++) {
+            writer->iov[i + 1].iov_base = slot->segment[i];
+            writer->iov[i + 1].iov_len = slot->segment_length[i];
+            length += slot->segment_length[i];
+        }
+        // A delta without changes is written as a repeated tick.
+        if (!slot->delta) {
+            record = TRACE_RECORD_KEYFRAME;
+        } else if (length > 0) {
+            record = TRACE_RECORD_DELTA;
+        }
+    }
+    char *prefix_end = append_varint(writer->prefix, record);
+    if (record != TRACE_RECORD_REPEAT) {
+        prefix_end = append_varint(prefix_end, length);
+        iovcnt += writer->num_segments;
+    }
+    writer->iov[0].iov_base = writer->prefix;
+    writer->iov[0].iov_len = prefix_end - writer->prefix;
+    if (record == TRACE_RECORD_KEYFRAME) {
+        index_trace_tick(writer, slot->time_tick);
+    }
+    emit_trace(writer, writer->iov, iovcnt);
+}
+
+static void write_slot(struct trace_writer *writer, struct trace_slot *slot) {
+    int i;
+    if (writer->format != TRACE_FORMAT_TEXT) {
+        // The decoder repeats the previous tick itself, so the segments do not have to be kept.
+        write_binary_slot(writer, slot);
+        return;
+    }
+    if (!slot->repeat) {
+        // Keep the segments of this tick for the repeated ticks, the slot gets the spare set.
+        char **segment = slot->segment;
+        int *segment_length = slot->segment_length;
+        slot->segment = writer->last.segment;
+        slot->segment_length = writer->last.segment_length;
+        writer->last.segment = segment;
+        writer->last.segment_length = segment_length;
+    }
+    writer->iov[0].iov_base = writer->prefix;
+    writer->iov[0].iov_len = append_number(writer->prefix, slot->time_tick) - writer->prefix;
+    writer->prefix[writer->iov[0].iov_len++] = ':';
+    for (i = 0; i < writer->num_segments; i++) {
+        writer->iov[i + 1].iov_base = writer->last.segment[i];
+        writer->iov[i + 1].iov_len = writer->last.segment_length[i];
+    }
+    writer->iov[writer->num_segments + 1].iov_base = "\n";
+    writer->iov[writer->num_segments + 1].iov_len = 1;
+    index_trace_tick(writer, slot->time_tick);
+    emit_trace(writer, writer->iov, writer->num_segments + 2);
+}
+
+static void init_trace_slot(struct trace_slot *slot, int num_segments, int segment_capacity) {
+    int i;
+    slot->segment = (char**)malloc(num_segments * sizeof(char*));
+    slot->segment_length = (int*)calloc(num_segments, sizeof(int));
+    for (i = 0; i < num_segments; i++) {
+        slot->segment[i] = (char*)malloc(segment_capacity);
+    }
+}
+
+static void free_trace_slot(struct trace_slot *slot, int num_segments) {
+    int i;
+    for (i = 0; i < num_segments; i++) {
+        free(slot->segment[i]);
+    }
+    free(slot->segment);
+    free(slot->segment_length);
+}
+
+static void *run_trace_writer(void *argument) {
+    struct trace_writer *writer = (struct trace_writer*)argument;
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        while (writer->count == 0 && !writer->closing) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->count == 0) {
+            break;
+        }
+        struct trace_slot *slot = &writer->slots[writer->tail];
+        pthread_mutex_unlock(&writer->lock);
+        write_slot(writer, slot);
+        pthread_mutex_lock(&writer->lock);
+        writer->tail = (writer->tail + 1) % TRACE_RING_SIZE;
+        writer->count--;
+        pthread_cond_signal(&writer->not_full);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/**
+ * Starts the writer thread. Every tick is written in num_segments segments of up to segment_trains trains each, as text,
+ * as packed train states or as the changes of the train states with a keyframe every keyframe_interval ticks (format).
+ * The traced ticks start at first_tick and are tick_step ticks apart. The trace is written to the file of fp, as a zstd
+ * frame if compress is 1, and fp must not be written to any more. If index is not NULL, the offsets of ticks that can be
+ * read on its own are written to it, a keyframe interval apart at least. The trace is complete after
+ * finish_trace_writer.
+ */
+void open_trace_writer(struct trace_writer *writer, FILE *fp, FILE *index, int compress, int format, int keyframe_interval, int first_tick, int tick_step, int num_segments, int segment_trains) {
+    int i;
+    if (num_segments + 2 > sysconf(_SC_IOV_MAX)) {
+        fprintf(stderr, "Error! The trace can not be written in %d segments\n", num_segments);
+        exit(1);
+    }
+    fflush(fp);
+    writer->fd = fileno(fp);
+    writer->offset = 0;
+    writer->compress = compress;
+#ifdef TRACE_ZSTD
+    if (compress) {
+        writer->compressor = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter(writer->compressor, ZSTD_c_compressionLevel, TRACE_ZSTD_LEVEL);
+        ZSTD_CCtx_setParameter(writer->compressor, ZSTD_c_checksumFlag, 1);
+        writer->block = (char*)malloc(TRACE_BLOCK_SIZE);
+        writer->block_length = 0;
+        writer->compressed_capacity = ZSTD_CStreamOutSize();
+        writer->compressed = (char*)malloc(writer->compressed_capacity);
+    }
+#else
+    if (compress) {
+        fprintf(stderr, "Error! The trace can only be compressed when built with -DTRACE_ZSTD\n");
+        exit(1);
+    }
+#endif
+    writer->format = format;
+    writer->keyframe_interval = keyframe_interval;
+    writer->first_tick = first_tick;
+    writer->tick_step = tick_step;
+    writer->index = index;
+    writer->last_indexed_tick = -1;
+    if (index != NULL) {
+        fwrite(TRACE_INDEX_MAGIC, 1, TRACE_MAGIC_SIZE, index);
+        fwrite(&format, sizeof(int), 1, index);
+        fwrite(&keyframe_interval, sizeof(int), 1, index);
+    }
+    writer->num_segments = num_segments;
+    writer->segment_capacity = segment_trains * TRACE_TOKEN_SIZE + 1;
+    for (i = 0; i < TRACE_RING_SIZE; i++) {
+        init_trace_slot(&writer->slots[i], num_segments, writer->segment_capacity);
+    }
+    init_trace_slot(&writer->last, num_segments, writer->segment_capacity);
+    writer->iov = (struct iovec*)malloc((num_segments + 2) * sizeof(struct iovec));
+    writer->head = 0;
+    writer->tail = 0;
+    writer->count = 0;
+    writer->closing = 0;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+    if (pthread_create(&writer->thread, NULL, run_trace_writer, writer) != 0) {
+        fprintf(stderr, "Error! starting the trace writer\n");
+        exit(1);
+    }
+}
+
+/**
+ * Returns the slot for the positions of the trains in time_tick. Waits while every slot is still to be written.
+ * The segments of the slot are filled by the simulation and the slot is handed to the writer by end_trace_tick.
+ */
+struct trace_slot *begin_trace_tick(struct trace_writer *writer, int time_tick) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->count == TRACE_RING_SIZE) {
+        pthread_cond_wait(&writer->not_full, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    struct trace_slot *slot = &writer->slots[writer->head];
+    slot->time_tick = time_tick;
+    slot->repeat = 0;
+    slot->delta = writer->format == TRACE_FORMAT_DELTA && !trace_keyframe_due(writer, time_tick);
+    return slot;
+}
+
+/**
+ * 1 if the delta trace needs the full states of the trains in time_tick, even if no train moved. That is the first
+ * traced tick, every keyframe interval after it, and every traced tick when the ticks are sampled.
+ */
+int trace_keyframe_due(struct trace_writer *writer, int time_tick) {
+    return writer->format == TRACE_FORMAT_DELTA && (writer->tick_step != 1 || time_tick == writer->first_tick || (time_tick - writer->first_tick) % writer->keyframe_interval == 0);
+}
+
+void end_trace_tick(struct trace_writer *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->head = (writer->head + 1) % TRACE_RING_SIZE;
+    writer->count++;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Logs time_tick with the same positions as the previous tick, without copying them.
+ */
+void repeat_trace_tick(struct trace_writer *writer, int time_tick) {
+    struct trace_slot *slot = begin_trace_tick(writer, time_tick);
+    slot->repeat = 1;
+    end_trace_tick(writer);
+}
+
+/**
+ * Writes out every filled slot and stops the writer thread.
+ */
+void close_trace_writer(struct trace_writer *writer) {
+    int i;
+    pthread_mutex_lock(&writer->lock);
+    writer->closing = 1;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    for (i = 0; i < TRACE_RING_SIZE; i++) {
+        free_trace_slot(&writer->slots[i], writer->num_segments);
+    }
+    free_trace_slot(&writer->last, writer->num_segments);
+    free(writer->iov);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_cond_destroy(&writer->not_full);
+}
+
+/**
+ * Writes bytes that are not a tick (the header, the summary) to the trace. Only called before the first tick is handed
+ * to the writer, or after the writer is closed.
+ */
+void write_trace_data(struct trace_writer *writer, const void *data, size_t length) {
+    struct iovec iov = {(void*)data, length};
+    emit_trace(writer, &iov, 1);
+}
+
+/**
+ * Ends the zstd frame of a compressed trace. Called once, after close_trace_writer and the last write_trace_data.
+ */
+void finish_trace_writer(struct trace_writer *writer) {
+#ifdef TRACE_ZSTD
+    if (writer->compress) {
+        compress_trace_block(writer, ZSTD_e_end);
+        ZSTD_freeCCtx(writer->compressor);
+        free(writer->block);
+        free(writer->compressed);
+    }
+#else
+    (void)writer;
+#endif
+}
+
+static void write_trace_int(struct trace_writer *writer, int value) {
+    write_trace_data(writer, &value, sizeof(int));
+}
+
+/**
+ * Writes the header of a binary trace. Called before the first tick.
+ */
+void write_trace_header(struct trace_writer *writer, struct trace_header *header) {
+    int i;
+    int line;
+    write_trace_data(writer, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    write_trace_int(writer, TRACE_VERSION);
+    write_trace_int(writer, header->num_ticks);
+    write_trace_int(writer, header->first_tick);
+    write_trace_int(writer, header->tick_step);
+    write_trace_int(writer, header->keyframe_interval);
+    write_trace_int(writer, header->num_stations);
+    for (line = 0; line < 3; line++) {
+        write_trace_int(writer, header->num_line_trains[line]);
+    }
+    for (i = 0; i < header->num_stations; i++) {
+        int length = strlen(header->station_names[i]);
+        write_trace_int(writer, length);
+        write_trace_data(writer, header->station_names[i], length);
+    }
+    for (line = 0; line < 3; line++) {
+        write_trace_int(writer, header->num_line_stations[line]);
+        write_trace_data(writer, header->line_stations[line], header->num_line_stations[line] * sizeof(int));
+    }
+}
+
+/**
+ * Maps a whole file into memory, read only. Returns NULL if the file can not be opened.
+ */
+const unsigned char *map_trace_file(const char *file_name, size_t *size) {
+    struct stat file_stat;
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        return NULL;
+    }
+    *size = file_stat.st_size;
+    if (*size == 0) {
+        close(fd);
+        return (const unsigned char*)"";
+    }
+    void *data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    return (const unsigned char*)data;
+}
+
+void unmap_trace_file(const unsigned char *data, size_t size) {
+    if (size > 0) {
+        munmap((void*)data, size);
+    }
+}
+
+static void read_trace_bytes(struct trace_reader *reader, void *out, size_t length) {
+    if (length > reader->size - reader->position) {
+        fprintf(stderr, "Error! The trace header is cut short\n");
+        exit(1);
+    }
+    memcpy(out, reader->data + reader->position, length);
+    reader->position += length;
+}
+
+static int read_trace_int(struct trace_reader *reader) {
+    int value;
+    read_trace_bytes(reader, &value, sizeof(int));
+    return value;
+}
+
+static void read_trace_header(struct trace_reader *reader, struct trace_header *header) {
+    int i;
+    int line;
+    char magic[TRACE_MAGIC_SIZE];
+    read_trace_bytes(reader, magic, TRACE_MAGIC_SIZE);
+    if (memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "Error! Not a binary trace\n");
+        exit(1);
+    }
+    if (read_trace_int(reader) != TRACE_VERSION) {
+        fprintf(stderr, "Error! Unknown version of the binary trace\n");
+        exit(1);
+    }
+    header->num_ticks = read_trace_int(reader);
+    header->first_tick = read_trace_int(reader);
+    header->tick_step = read_trace_int(reader);
+    if (header->num_ticks < 0 || header->first_tick < 0 || header->tick_step < 1) {
+        fprintf(stderr, "Error! Not a binary trace\n");
+        exit(1);
+    }
+    header->keyframe_interval = read_trace_int(reader);
+    header->num_stations = read_trace_int(reader);
+    for (line = 0; line < 3; line++) {
+        header->num_line_trains[line] = read_trace_int(reader);
+    }
+    header->station_names = (char**)malloc(header->num_stations * sizeof(char*));
+    for (i = 0; i < header->num_stations; i++) {
+        int length = read_trace_int(reader);
+        header->station_names[i] = (char*)malloc(length + 1);
+        read_trace_bytes(reader, header->station_names[i], length);
+        header->station_names[i][length] = '\0';
+    }
+    for (line = 0; line < 3; line++) {
+        header->num_line_stations[line] = read_trace_int(reader);
+        header->line_stations[line] = (int*)malloc(header->num_line_stations[line] * sizeof(int));
+        read_trace_bytes(reader, header->line_stations[line], header->num_line_stations[line] * sizeof(int));
+    }
+}
+
+static void free_trace_header(struct trace_header *header) {
+    int i;
+    int line;
+    for (i = 0; i < header->num_stations; i++) {
+        free(header->station_names[i]);
+    }
+    free(header->station_names);
+    for (line = 0; line < 3; line++) {
+        free(header->line_stations[line]);
+    }
+}
+
+/**
+ * Maps a binary trace and reads its header. The states of the trains are before the first tick (no train in the network).
+ */
+void open_trace_reader(struct trace_reader *reader, const char *file_name) {
+    int line;
+    reader->data = map_trace_file(file_name, &reader->size);
+    if (reader->data == NULL) {
+        printf("Error! opening file %s\n", file_name);
+        exit(1);
+    }
+    reader->position = 0;
+    read_trace_header(reader, &reader->header);
+    reader->num_trains = 0;
+    for (line = 0; line < 3; line++) {
+        reader->num_trains += reader->header.num_line_trains[line];
+    }
+    reader->first_record = reader->position;
+    reader->time_tick = reader->header.first_tick - reader->header.tick_step;
+    reader->states = (unsigned int*)calloc(reader->num_trains + 1, sizeof(unsigned int));
+}
+
+void close_trace_reader(struct trace_reader *reader) {
+    free(reader->states);
+    free_trace_header(&reader->header);
+    unmap_trace_file(reader->data, reader->size);
+}
+
+static int read_trace_varint(struct trace_reader *reader, unsigned int *value) {
+    int shift = 0;
+    size_t start = reader->position;
+    unsigned char byte;
+    *value = 0;
+    do {
+        if (reader->position == reader->size) {
+            fprintf(stderr, "Error! The trace ends after time tick %d\n", reader->time_tick);
+            exit(1);
+        }
+        byte = reader->data[reader->position++];
+        *value |= (unsigned int)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return reader->position - start;
+}
+
+/**
+ * Reads the record of the next tick and applies it to the states of the trains. Returns the type of the record.
+ */
+int read_trace_tick(struct trace_reader *reader) {
+    unsigned int record;
+    unsigned int length;
+    unsigned int train_number;
+    unsigned int i;
+    read_trace_varint(reader, &record);
+    if (record != TRACE_RECORD_REPEAT) {
+        read_trace_varint(reader, &length);
+    }
+    if (record == TRACE_RECORD_KEYFRAME) {
+        for (i = 0; i < (unsigned int)reader->num_trains; i++) {
+            read_trace_varint(reader, &reader->states[i]);
+        }
+    } else if (record == TRACE_RECORD_DELTA) {
+        i = 0;
+        while (i < length) {
+            i += read_trace_varint(reader, &train_number);
+            if (train_number >= (unsigned int)reader->num_trains) {
+                fprintf(stderr, "Error! Unknown train %u at time tick %d\n", train_number, reader->time_tick + reader->header.tick_step);
+                exit(1);
+            }
+            i += read_trace_varint(reader, &reader->states[train_number]);
+        }
+    } else if (record != TRACE_RECORD_REPEAT) {
+        fprintf(stderr, "Error! Unknown record at time tick %d\n", reader->time_tick + reader->header.tick_step);
+        exit(1);
+    }
+    reader->time_tick += reader->header.tick_step;
+    return record;
+}
+
+/**
+ * Moves the reader to a keyframe found in the index: the record of time_tick starts at offset.
+ */
+void seek_trace(struct trace_reader *reader, long long offset, int time_tick) {
+    if (offset < (long long)reader->first_record || offset >= (long long)reader->size) {
+        fprintf(stderr, "Error! The index points out of the trace\n");
+        exit(1);
+    }
+    reader->position = offset;
+    reader->time_tick = time_tick - reader->header.tick_step;
+}
+
+/**
+ * Brings the states of the trains to time_tick, which must be a traced tick. Goes through the records up to time_tick without decoding them to find
+ * the last keyframe, and only applies the records from there.
+ */
+void replay_trace(struct trace_reader *reader, int time_tick) {
+    unsigned int record;
+    unsigned int length;
+    int tick;
+    int first_tick = reader->header.first_tick;
+    int step = reader->header.tick_step;
+    if (time_tick < first_tick || time_tick >= first_tick + reader->header.num_ticks * step || (time_tick - first_tick) % step != 0) {
+        fprintf(stderr, "Error! Time tick %d is not in the trace\n", time_tick);
+        exit(1);
+    }
+    if (time_tick < reader->time_tick) {
+        reader->position = reader->first_record;
+        memset(reader->states, 0, reader->num_trains * sizeof(unsigned int));
+        reader->time_tick = first_tick - step;
+    }
+    size_t start = reader->position;
+    size_t keyframe = 0;
+    int keyframe_tick = -1;
+    for (tick = reader->time_tick + step; tick <= time_tick; tick += step) {
+        size_t offset = reader->position;
+        read_trace_varint(reader, &record);
+        if (record == TRACE_RECORD_REPEAT) {
+            continue;
+        }
+        read_trace_varint(reader, &length);
+        if (record == TRACE_RECORD_KEYFRAME) {
+            keyframe = offset;
+            keyframe_tick = tick;
+        }
+        if (length > reader->size - reader->position) {
+            fprintf(stderr, "Error! The trace ends after time tick %d\n", tick - step);
+            exit(1);
+        }
+        reader->position += length;
+    }
+    if (keyframe_tick >= 0) {
+        reader->position = keyframe;
+        reader->time_tick = keyframe_tick - step;
+    } else {
+        reader->position = start;
+    }
+    while (reader->time_tick < time_tick) {
+        read_trace_tick(reader);
+    }
+}
+
+/**
+ * Formats the states of the trains into the log tokens of a tick, and returns their length. line needs room for
+ * TRACE_TOKEN_SIZE bytes per train.
+ */
+int format_trace_states(struct trace_reader *reader, char *line) {
+    int i;
+    int j;
+    int line_index;
+    int train_number = 0;
+    char line_letters[3] = {'g', 'y', 'b'};
+    char *end = line;
+    for (line_index = 0; line_index < 3; line_index++) {
+        int num_stations = reader->header.num_line_stations[line_index];
+        int *stations = reader->header.line_stations[line_index];
+        for (i = 0; i < reader->header.num_line_trains[line_index]; i++, train_number++) {
+            unsigned int state = reader->states[train_number];
+            if (state == 0) {
+                continue;
+            }
+            state--;
+            j = state >> 2;
+            if (j >= num_stations) {
+                fprintf(stderr, "Error! Train %c%d is at an unknown station\n", line_letters[line_index], i);
+                exit(1);
+            }
+            if (state & 1) {
+                end = append_train_position(end, line_letters[line_index], i, stations[j], stations[route_next_station(j, (state >> 1) & 1, num_stations)]);
+            } else {
+                end = append_train_position(end, line_letters[line_index], i, stations[j], TRACE_IN_STATION);
+            }
+        }
+    }
+    return end - line;
+}
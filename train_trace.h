@@ -0,0 +1,179 @@
+/*
+ * Trace (log.txt) writer of the OpenMP simulator.
+ *
+ * The simulation does not write the log. At the end of a time tick every thread formats the positions of its own chunk of
+ * trains into its segment of a slot of a ring of pre-sized tick buffers, and the simulation goes on with the next tick. A
+ * writer thread takes the slots in order and writes each tick with a single writev of its segments, so the log line is put
+ * together in train order (green, yellow, blue) without being copied. When the writer falls behind and every slot is full,
+ * the simulation waits for a slot (bounded backpressure), so at most TRACE_RING_SIZE ticks are buffered.
+ *
+ * A repeated tick (no train moved) has no segments, the writer writes the segments of the last tick it wrote again. To
+ * keep them, the writer swaps the segment buffers of every slot it writes with its own spare set.
+ *
+ * BINARY TRACE (--trace=bin): The same ticks, written as packed train states instead of text. All ints are 32 bit, in
+ * the byte order of the host.
+ * Header: "TRNTRACE", version, number of traced ticks, first traced tick, ticks between traced ticks, keyframe
+ *         interval, number of stations, number of green, yellow and blue trains, the name of every station (length,
+ *         then the characters) and, for green, yellow and blue, the number of stations of the line followed by their
+ *         global indices.
+ * Ticks: one record per tick, a varint with the type of the record, then (but for a repeat) a varint with the number of
+ *        bytes that follow.
+ *        TRACE_RECORD_KEYFRAME: one state per train in the order of the log.
+ *        TRACE_RECORD_DELTA: (global train index, state) of the trains that moved in the tick.
+ *        TRACE_RECORD_REPEAT: no train moved, the states of the previous tick are repeated.
+ *        A state is a varint: 0 if the train is not in the network, else 1 + (local station << 2 | direction << 1 | in
+ *        transit). A train in transit is going to route_next_station(station, direction) of its line.
+ * Footer: the text of the summary, exactly as at the end of log.txt.
+ * --trace=bin writes only keyframes (and repeats). --trace=delta writes deltas, with a keyframe every keyframe interval
+ * ticks so that a tick can be rebuilt without going through all the ticks before it (replay_trace). trace_decode turns
+ * a binary trace back into the text log.
+ *
+ * INDEX (log.txt.idx, log.bin.idx): "TRNINDEX", the format of the trace and the keyframe interval (ints), then a
+ * trace_index_entry for every tick that can be read without the ticks before it (any line of a text trace, a keyframe of
+ * a binary trace), at least a keyframe interval apart. trace_query finds the last entry before a tick by binary search,
+ * so it only reads the trace from there.
+ *
+ * RUN MODES (--sample=K, --window=T0:T1): Only some ticks are traced, the first tick and the step between two traced ticks
+ * are in the header. A repeat or delta record is relative to the previous traced tick. When the step is more than one
+ * tick every record of a delta trace is a keyframe, a delta over several ticks would save little.
+ *
+ * COMPRESSION (--compress, built with -DTRACE_ZSTD and linked with -lzstd): The writer thread gathers the trace into fixed
+ * size blocks and streams each full block into one zstd frame as it goes, so compression overlaps with the ticks. The
+ * frame is only ended when the writer is closed. "zstd -d log.txt.zst" gives back log.txt. The index is not written for a
+ * compressed trace.
+ */
+#ifndef TRAIN_TRACE_H
+#define TRAIN_TRACE_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#ifdef TRACE_ZSTD
+#include <zstd.h>
+#endif
+
+#define TRACE_RING_SIZE 8
+#define TRACE_TOKEN_SIZE 40         // longest " g<train>-s<station>->s<station>," token
+#define TRACE_PREFIX_SIZE 16        // longest "<tick>:" prefix
+#define TRACE_IN_STATION -1
+
+// Formats
+#define TRACE_FORMAT_TEXT 0
+#define TRACE_FORMAT_BINARY 1
+#define TRACE_FORMAT_DELTA 2
+
+// Records of the binary trace
+#define TRACE_RECORD_REPEAT 0
+#define TRACE_RECORD_KEYFRAME 1
+#define TRACE_RECORD_DELTA 2
+
+#define TRACE_KEYFRAME_INTERVAL 1000
+
+#define TRACE_BLOCK_SIZE (1 << 20)  // bytes of trace compressed at a time
+#define TRACE_ZSTD_LEVEL 3
+
+#define TRACE_MAGIC "TRNTRACE"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 3
+#define TRACE_INDEX_MAGIC "TRNINDEX"
+#define TRACE_INDEX_HEADER_SIZE (TRACE_MAGIC_SIZE + 2 * sizeof(int))
+#define TRACE_VARINT_SIZE 5         // longest varint of an unsigned int
+
+struct trace_slot
+{
+    int time_tick;
+    int repeat;                 // 1 if no train moved since the previous tick, the segments are not filled
+    int delta;                  // 1 if the segments only hold the trains that moved in the tick (delta trace)
+    char **segment;             // [segment] positions of a chunk of trains
+    int *segment_length;        // [segment]
+};
+
+struct trace_index_entry
+{
+    long long time_tick;
+    long long offset;           // byte offset of the line or record of the tick in the trace
+};
+
+struct trace_header
+{
+    int num_ticks;              // number of traced ticks
+    int first_tick;             // time tick of the first traced tick
+    int tick_step;              // time ticks between two traced ticks
+    int keyframe_interval;
+    int num_stations;
+    char **station_names;       // [station]
+    int num_line_trains[3];     // green, yellow, blue
+    int num_line_stations[3];
+    int *line_stations[3];      // [line][local station] -> global station
+};
+
+struct trace_writer
+{
+    int fd;
+    int format;                 // TRACE_FORMAT_TEXT | TRACE_FORMAT_BINARY | TRACE_FORMAT_DELTA
+    int keyframe_interval;
+    int first_tick;             // first traced tick
+    int tick_step;              // time ticks between two traced ticks
+    int num_segments;
+    int segment_capacity;       // bytes of each segment
+    struct trace_slot slots[TRACE_RING_SIZE];
+    FILE *index;                // NULL for no index
+    int head;                   // next slot to fill (simulation)
+    int tail;                   // next slot to write (writer thread)
+    int count;                  // number of filled slots
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t thread;
+    // Owned by the writer thread
+    struct trace_slot last;     // segments of the last written tick
+    struct iovec *iov;          // prefix, segments and newline of a tick
+    long long offset;           // bytes in the trace so far (before compression)
+    int last_indexed_tick;      // -1 before the first entry
+    int compress;
+#ifdef TRACE_ZSTD
+    ZSTD_CCtx *compressor;
+    char *block;                // trace not compressed yet
+    size_t block_length;
+    char *compressed;
+    size_t compressed_capacity;
+#endif
+    char prefix[TRACE_PREFIX_SIZE];
+};
+
+struct trace_reader
+{
+    const unsigned char *data;  // the mapped trace
+    size_t size;
+    size_t position;            // offset of the record of the next tick
+    struct trace_header header;
+    int num_trains;
+    size_t first_record;        // offset of the record of the first traced tick
+    int time_tick;              // time tick of the states, first tick - tick step before the first tick
+    unsigned int *states;       // [train] state of the train in time_tick
+};
+
+void open_trace_writer(struct trace_writer *writer, FILE *fp, FILE *index, int compress, int format, int keyframe_interval, int first_tick, int tick_step, int num_segments, int segment_trains);
+struct trace_slot *begin_trace_tick(struct trace_writer *writer, int time_tick);
+void end_trace_tick(struct trace_writer *writer);
+void repeat_trace_tick(struct trace_writer *writer, int time_tick);
+int trace_keyframe_due(struct trace_writer *writer, int time_tick);
+void close_trace_writer(struct trace_writer *writer);
+void write_trace_data(struct trace_writer *writer, const void *data, size_t length);
+void finish_trace_writer(struct trace_writer *writer);
+char *append_train_position(char *out, char line_letter, int train_index, int from_station, int to_station);
+char *append_varint(char *out, unsigned int value);
+
+void write_trace_header(struct trace_writer *writer, struct trace_header *header);
+
+const unsigned char *map_trace_file(const char *file_name, size_t *size);
+void unmap_trace_file(const unsigned char *data, size_t size);
+void open_trace_reader(struct trace_reader *reader, const char *file_name);
+void close_trace_reader(struct trace_reader *reader);
+int read_trace_tick(struct trace_reader *reader);
+void seek_trace(struct trace_reader *reader, long long offset, int time_tick);
+void replay_trace(struct trace_reader *reader, int time_tick);
+int format_trace_states(struct trace_reader *reader, char *line);
+
+#endif
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "train_wheel.h"
+
+static void insert_event(struct timing_wheel *wheel, int id) {
+    unsigned int due = wheel->due[id];
+    unsigned int difference = due ^ (unsigned int)wheel->now;
+    int level = 0;
+    while (difference >= WHEEL_SIZE) {
+        difference >>= WHEEL_BITS;
+        level++;
+    }
+    int slot = (due >> (level * WHEEL_BITS)) & (WHEEL_SIZE - 1);
+    wheel->next[id] = wheel->slot[level][slot];
+    wheel->slot[level][slot] = id;
+}
+
+void init_timing_wheel(struct timing_wheel *wheel, int num_ids, int now) {
+    int level;
+    int slot;
+    wheel->now = now;
+    wheel->next = (int*)malloc(num_ids * sizeof(int));
+    wheel->due = (int*)malloc(num_ids * sizeof(int));
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SIZE; slot++) {
+            wheel->slot[level][slot] = WHEEL_NONE;
+        }
+    }
+}
+
+void free_timing_wheel(struct timing_wheel *wheel) {
+    free(wheel->next);
+    free(wheel->due);
+}
+
+/**
+ * Schedules the event of id at the time tick due, which must be after the current time tick.
+ * The id must not have another pending event.
+ */
+void schedule_event(struct timing_wheel *wheel, int id, int due) {
+    if (due <= wheel->now) {
+        fprintf(stderr, "Error! Event at time tick %d scheduled at time tick %d\n", due, wheel->now);
+        exit(1);
+    }
+    wheel->due[id] = due;
+    insert_event(wheel, id);
+}
+
+/**
+ * Moves the wheel to the next time tick and returns the first id whose event is due in it (WHEEL_NONE if there are none).
+ * The other due ids follow through next[id]. Read next[id] before scheduling id again.
+ */
+int advance_timing_wheel(struct timing_wheel *wheel) {
+    int level;
+    int top_level = 0;
+    int head;
+    wheel->now++;
+    unsigned int now = wheel->now;
+    // Cascade the levels whose block starts at this tick, from the highest down, so events move to their lowest level.
+    while (top_level + 1 < WHEEL_LEVELS && (now & ((1u << ((top_level + 1) * WHEEL_BITS)) - 1)) == 0) {
+        top_level++;
+    }
+    for (level = top_level; level > 0; level--) {
+        int slot = (now >> (level * WHEEL_BITS)) & (WHEEL_SIZE - 1);
+        int id = wheel->slot[level][slot];
+        wheel->slot[level][slot] = WHEEL_NONE;
+        while (id != WHEEL_NONE) {
+            int next = wheel->next[id];
+            insert_event(wheel, id);
+            id = next;
+        }
+    }
+    head = wheel->slot[0][now & (WHEEL_SIZE - 1)];
+    wheel->slot[0][now & (WHEEL_SIZE - 1)] = WHEEL_NONE;
+    return head;
+}
@@ -0,0 +1,31 @@
+/*
+ * Hierarchical timing wheel used by the event engine of the OpenMP simulator.
+ *
+ * Every id (a train) has at most one pending event, so the slots are intrusive singly linked lists threaded through
+ * next[id]. Level 0 holds the events of the current block of 64 time ticks, one slot per tick. Level l holds events
+ * whose due tick first differs from the current tick in bits [6l, 6l + 6), and is cascaded to the lower levels when the
+ * current tick reaches the start of their block. Scheduling and advancing by one tick are O(1) (amortized), no matter
+ * how far ahead the event is.
+ */
+#ifndef TRAIN_WHEEL_H
+#define TRAIN_WHEEL_H
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6      // 6 x 6 bits covers every time tick that fits in an int
+#define WHEEL_NONE -1
+
+struct timing_wheel
+{
+    int now;                            // current time tick
+    int *next;                          // [id] next id in the same slot | WHEEL_NONE
+    int *due;                           // [id] time tick of the pending event of the id
+    int slot[WHEEL_LEVELS][WHEEL_SIZE]; // first id in each slot | WHEEL_NONE
+};
+
+void init_timing_wheel(struct timing_wheel *wheel, int num_ids, int now);
+void free_timing_wheel(struct timing_wheel *wheel);
+void schedule_event(struct timing_wheel *wheel, int id, int due);
+int advance_timing_wheel(struct timing_wheel *wheel);
+
+#endif